@@ -0,0 +1,427 @@
+/*
+** bench_host.c
+**
+** Times the snake (see snake.h) on a Linux host against the circular
+** buffer of 40 positions it replaced (snakePositions, with head and
+** tail indexes), which is kept here as ring_*(). Both run on
+** the same board, food and wall modules, and the board layers are
+** compared after each run to check that they did the same thing.
+** Three things are timed:
+**	- moves around a loop of the board, for a few snake lengths
+**	- walking the snake from the tail to the head
+**	- tail-cuts - the head running into its own body
+** (The old tail-cut searched the buffer for the segment that was run
+** into, then cleared each cell from the snake layer and added it with
+** add_wall_at().)
+**
+** Usage: snake_bench [moves]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hal.h"
+#include "board.h"
+#include "snake.h"
+#include "food.h"
+#include "wall.h"
+#include "position.h"
+
+/* The loop the snake follows - up column 0 from the bottom, then
+** back and forth along the rows of columns 1 to 5 from the top down,
+** ending next to where it started. (The board is 7 x 15 - the loop
+** leaves out column 6 and row 14, as a loop must cover an even number
+** of cells.)
+*/
+#define LOOP_LENGTH (6 * 14)
+static PosnType loop[LOOP_LENGTH];
+
+/* Each tail-cut is repeated CUT_REPEATS times in each of CUT_RUNS
+** runs
+*/
+#define CUT_REPEATS 100000
+#define CUT_RUNS 7
+
+/* external variables */
+extern int8_t curSnakeDirn;
+extern int8_t nextSnakeDirn;
+extern int8_t numFoodItems;
+
+/*
+** The old snake - positions in a circular buffer. It was only
+** as long as the longest snake, 40 segments.
+*/
+#define RING_SIZE 40
+
+static PosnType ringPositions[RING_SIZE];
+static int8_t ringHeadIndex;
+static int8_t ringTailIndex;
+
+static int8_t ring_length(void) {
+	int8_t len = ringHeadIndex - ringTailIndex + 1;
+	if(len <= 0) {
+		len += RING_SIZE;
+	}
+	return len;
+}
+
+static int8_t ring_index_at(PosnType posn) {
+	int8_t index = ringTailIndex;
+	while(ringPositions[index] != posn) {
+		if(++index == RING_SIZE) {
+			index = 0;
+		}
+	}
+	return index;
+}
+
+static int8_t ring_move_snake(RandomType* rng) {
+	int8_t foodAtHead;
+	int8_t grow;
+	int8_t headX;
+	int8_t headY;
+	int8_t cutIndex;
+	PosnType headPosn;
+
+	headX = (ringPositions[ringHeadIndex] >> 4) & 0x07;
+	headY = ringPositions[ringHeadIndex] & 0x0F;
+	switch(nextSnakeDirn) {
+		case UP:
+			headY += 1;
+			break;
+		case RIGHT:
+			headX += 1;
+			break;
+		case DOWN:
+			headY -= 1;
+			break;
+		case LEFT:
+			headX -= 1;
+			break;
+	}
+	headPosn = position(headX, headY);
+	curSnakeDirn = nextSnakeDirn;
+	if(is_off_board(headX, headY)) {
+		return OUT_OF_BOUNDS;
+	}
+
+	/* Tail-cut */
+	if(is_snake_at(headPosn)) {
+		cutIndex = ring_index_at(headPosn);
+		while(ringTailIndex != cutIndex) {
+			clear_occupied(SNAKE_LAYER, ringPositions[ringTailIndex]);
+			add_wall_at(ringPositions[ringTailIndex++]);
+			if(ringTailIndex == RING_SIZE) {
+				ringTailIndex = 0;
+			}
+		}
+		flag_wall();
+	}
+	if(is_wall_at(headPosn)) {
+		return COLLISION;
+	}
+
+	foodAtHead = food_at(headPosn);
+	grow = (foodAtHead != -1 && ring_length() < RING_SIZE);
+	if(++ringHeadIndex == RING_SIZE) {
+		ringHeadIndex = 0;
+	}
+	if(!grow) {
+		clear_occupied(SNAKE_LAYER, ringPositions[ringTailIndex]);
+		if(++ringTailIndex == RING_SIZE) {
+			ringTailIndex = 0;
+		}
+	}
+	ringPositions[ringHeadIndex] = headPosn;
+	set_occupied(SNAKE_LAYER, headPosn);
+
+	if(foodAtHead != -1) {
+		if(is_occupied(RAT_LAYER, headPosn)) {
+			remove_food(foodAtHead, rng);
+			return ATE_RAT;
+		}
+		remove_food(foodAtHead, rng);
+		return ATE_FOOD;
+	}
+	return MOVE_OK;
+}
+
+/*
+** The benchmark
+*/
+
+static double elapsed_ns(const struct timespec* start,
+		const struct timespec* end) {
+	return (end->tv_sec - start->tv_sec) * 1e9 +
+			(end->tv_nsec - start->tv_nsec);
+}
+
+static void make_loop(void) {
+	uint8_t i = 0;
+	uint8_t x;
+	int8_t y;
+
+	for(y = 0; y < 14; y++) {
+		loop[i++] = position(0, y);
+	}
+	for(y = 13; y >= 0; y--) {
+		for(x = 1; x <= 5; x++) {
+			loop[i++] = position(y & 1 ? x : 6 - x, y);
+		}
+	}
+}
+
+/* The direction of the step from one cell to the next */
+static int8_t step_dirn(PosnType from, PosnType to) {
+	if(x_position(to) > x_position(from)) {
+		return RIGHT;
+	}
+	if(x_position(to) < x_position(from)) {
+		return LEFT;
+	}
+	return y_position(to) > y_position(from) ? UP : DOWN;
+}
+
+/* Clear the board, and put each snake on the loop with its tail at
+** loop[start] and the given length
+*/
+static void start_board(void) {
+	clear_layers();
+	init_walls();
+	numFoodItems = 0;
+}
+
+static void start_snake(uint8_t start, uint8_t length) {
+	uint8_t i;
+
+	start_board();
+	set_snake_tail(loop[start]);
+	for(i = 1; i < length; i++) {
+		extend_snake(step_dirn(loop[(start + i - 1) % LOOP_LENGTH],
+				loop[(start + i) % LOOP_LENGTH]));
+	}
+	show_snake();
+	curSnakeDirn = step_dirn(loop[(start + length - 2) % LOOP_LENGTH],
+			loop[(start + length - 1) % LOOP_LENGTH]);
+}
+
+static void start_ring(uint8_t start, uint8_t length) {
+	uint8_t i;
+
+	start_board();
+	ringTailIndex = 0;
+	ringHeadIndex = length - 1;
+	for(i = 0; i < length; i++) {
+		ringPositions[i] = loop[(start + i) % LOOP_LENGTH];
+		set_occupied(SNAKE_LAYER, ringPositions[i]);
+	}
+	curSnakeDirn = step_dirn(loop[(start + length - 2) % LOOP_LENGTH],
+			loop[(start + length - 1) % LOOP_LENGTH]);
+}
+
+/* Move the snake the given number of times around the loop. Returns
+** the time per move.
+*/
+static double time_moves(uint8_t length, uint32_t moves, uint8_t ring,
+		RandomType* rng) {
+	struct timespec start;
+	struct timespec end;
+	uint8_t head = length - 1;
+	uint8_t next;
+	uint32_t i;
+	int8_t result = MOVE_OK;
+
+	if(ring) {
+		start_ring(0, length);
+	} else {
+		start_snake(0, length);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < moves && result == MOVE_OK; i++) {
+		next = head + 1 == LOOP_LENGTH ? 0 : head + 1;
+		nextSnakeDirn = step_dirn(loop[head], loop[next]);
+		result = ring ? ring_move_snake(rng) : move_snake(rng);
+		head = next;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if(result != MOVE_OK) {
+		fprintf(stderr, "Move %lu failed (%d)\n", (unsigned long)i, result);
+		exit(1);
+	}
+	return elapsed_ns(&start, &end) / moves;
+}
+
+/* Walk the snake from the tail to the head the given number of times.
+** Returns the time per segment.
+*/
+static double time_walks(uint32_t walks, uint8_t ring) {
+	struct timespec start;
+	struct timespec end;
+	SnakeIteratorType segment;
+	volatile uint32_t sink;
+	uint32_t sum = 0;
+	uint32_t i;
+	int8_t index;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < walks; i++) {
+		if(ring) {
+			index = ringTailIndex;
+			for(;;) {
+				sum += ringPositions[index];
+				if(index == ringHeadIndex) {
+					break;
+				}
+				if(++index == RING_SIZE) {
+					index = 0;
+				}
+			}
+		} else {
+			first_snake_segment(&segment);
+			do {
+				sum += segment.posn;
+			} while(next_snake_segment(&segment));
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	sink = sum;
+	(void)sink;
+	return elapsed_ns(&start, &end) / walks /
+			(ring ? ring_length() : get_snake_length());
+}
+
+/* Start a snake of RING_SIZE segments at loop[start], and run it into
+** itself in the given direction, CUT_REPEATS times. Returns the time
+** per cut - the time to start the snake is taken off, and each is the
+** quickest of CUT_RUNS runs, as the difference is small.
+*/
+static double time_cuts(uint8_t start, int8_t dirn, uint8_t ring,
+		RandomType* rng) {
+	struct timespec begin;
+	struct timespec end;
+	double ns;
+	double setupNs = 0;
+	double totalNs = 0;
+	uint32_t i;
+	uint8_t run;
+
+	for(run = 0; run < CUT_RUNS; run++) {
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		for(i = 0; i < CUT_REPEATS; i++) {
+			if(ring) {
+				start_ring(start, RING_SIZE);
+			} else {
+				start_snake(start, RING_SIZE);
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns = elapsed_ns(&begin, &end);
+		if(run == 0 || ns < setupNs) {
+			setupNs = ns;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		for(i = 0; i < CUT_REPEATS; i++) {
+			if(ring) {
+				start_ring(start, RING_SIZE);
+				nextSnakeDirn = dirn;
+				ring_move_snake(rng);
+			} else {
+				start_snake(start, RING_SIZE);
+				nextSnakeDirn = dirn;
+				move_snake(rng);
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns = elapsed_ns(&begin, &end);
+		if(run == 0 || ns < totalNs) {
+			totalNs = ns;
+		}
+	}
+	return (totalNs - setupNs) / CUT_REPEATS;
+}
+
+/* Save the board layers after a run of the new snake, or check them
+** against it after the same run of the old one
+*/
+static uint16_t savedLayers[NUM_LAYERS][BOARD_WIDTH];
+
+static void check_layers(uint8_t ring, const char* what) {
+	if(!ring) {
+		memcpy(savedLayers, boardLayers, sizeof(savedLayers));
+	} else if(memcmp(savedLayers, boardLayers, sizeof(savedLayers))) {
+		fprintf(stderr, "%s: the old and new snakes differ\n", what);
+		exit(1);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	static const uint8_t lengths[] = {3, 20, RING_SIZE};
+	uint32_t moves = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000000;
+	RandomType rng;
+	double ns[2];
+	uint8_t l;
+	uint8_t ring;
+	uint8_t start;
+	uint8_t head;
+	uint8_t cut;
+	int8_t dirn;
+	PosnType target;
+	char what[40];
+
+	if(moves == 0) {
+		fprintf(stderr, "Usage: snake_bench [moves]\n");
+		return 1;
+	}
+	hal_host_init(NULL, NULL);
+	random_seed(&rng, 1);
+	make_loop();
+
+	printf("%-24s %10s %10s\n", "", "ring (ns)", "steps (ns)");
+
+	/* Moves - the snake ends up on the same cells either way */
+	for(l = 0; l < sizeof(lengths); l++) {
+		for(ring = 0; ring < 2; ring++) {
+			ns[!ring] = time_moves(lengths[l], moves, ring, &rng);
+			check_layers(ring, "moves");
+		}
+		sprintf(what, "move, length %u", lengths[l]);
+		printf("%-24s %10.2f %10.2f\n", what, ns[0], ns[1]);
+	}
+
+	/* Walking the snake left by the last run */
+	ns[1] = time_walks(moves / RING_SIZE, 0);
+	start_ring(0, RING_SIZE);
+	ns[0] = time_walks(moves / RING_SIZE, 1);
+	printf("%-24s %10.2f %10.2f\n", "walk, per segment", ns[0], ns[1]);
+
+	/* Tail-cuts. With the tail at loop[4] the head is at (1,8) - to its
+	** left is the segment 4 from the tail, above it the segment 30 from
+	** the tail.
+	*/
+	start = 4;
+	head = start + RING_SIZE - 1;
+	for(dirn = 0; dirn < 4; dirn++) {
+		target = step_position(loop[head], dirn);
+		if(is_off_board(x_position(target), y_position(target))) {
+			continue;
+		}
+		for(cut = 0; cut < RING_SIZE - 2; cut++) {
+			if(loop[start + cut] == target) {
+				break;
+			}
+		}
+		if(cut == RING_SIZE - 2) {
+			/* Not a tail-cut */
+			continue;
+		}
+		for(ring = 0; ring < 2; ring++) {
+			ns[!ring] = time_cuts(start, dirn, ring, &rng);
+			check_layers(ring, "tail-cut");
+		}
+		sprintf(what, "tail-cut of %u cells", cut);
+		printf("%-24s %10.2f %10.2f\n", what, ns[0], ns[1]);
+	}
+	return 0;
+}
@@ -9,105 +9,446 @@
 #include "position.h"
 #include "board.h"
 #include "led_display.h"
-//#include "score.h" //16 OCT
+//#include "score.h" //16 OCT
 #include "snake.h"
 #include "food.h"
 #include <stdio.h>
+#include "hal.h"
 //4209435
 #include "wall.h"
+#include "terminalio.h"
+#include "serialio.h"
 
 /* Functions available within this file */
-static void turn_on_led_at(int8_t x, int8_t y);
-static void turn_off_led_at(int8_t x, int8_t y);
+static uint16_t occupied_cells(uint8_t x);
+#if BOARD_MIRROR
+static char mirror_glyph(uint8_t x, uint8_t y);
+static void draw_mirror_bytes(void);
+#endif
+
+/* Occupancy layers - see comment in header file */
+uint16_t boardLayers[NUM_LAYERS][BOARD_WIDTH];
+
+/* Number of free cells at each board x position, and in total */
+uint8_t freeCells[BOARD_WIDTH];
+uint8_t numFreeCells;
+
+/* LED compositor state - see comment in header file. boardChanged is
+** set when a layer changes. composedPhase is the blink phase the
+** display frame was last composed with - blinkPhase is changed by the
+** timer interrupt, so we compare rather than clearing a flag.
+*/
+#if DISPLAY_BAM
+uint8_t layerLevels[NUM_LAYERS] = {DISPLAY_MAX_LEVEL, 1, 2, DISPLAY_MAX_LEVEL};
+uint8_t blinkingLayers = 0;
+#else
+uint8_t layerLevels[NUM_LAYERS] = {1, 1, 1, 1};
+uint8_t blinkingLayers = (1 << FOOD_LAYER);
+#endif
+volatile uint8_t blinkPhase = 1;
+uint8_t composedPhase;
+uint8_t boardChanged;
+
+/* Terminal mirror of the board - see comment in header file.
+** mirrorDirty holds the cells which have changed (on any layer) since
+** they were last drawn on the terminal, in the same form as a layer.
+** The occupancy layer operations below mark the cells they change
+** (with MARK_MIRROR, which does nothing without the mirror).
+*/
+#if BOARD_MIRROR
+#define MARK_MIRROR(x, mask) (mirrorDirty[x] |= (mask))
+
+uint8_t mirrorOn;
+uint16_t mirrorDirty[BOARD_WIDTH];
+PosnType mirrorHead;	/* snake head position as last drawn */
+uint16_t mirrorBytes;	/* bytes sent so far this report period */
+uint8_t mirrorTicks;	/* game ticks so far this report period */
+uint16_t mirrorLastBytes;	/* bytes sent during the last report period */
+uint8_t mirrorBytesShown;	/* true if mirrorLastBytes is on the terminal */
+
+/* A gap of up to this many unchanged cells between changed cells is
+** redrawn rather than starting a new run (a cursor move costs more).
+*/
+#define MIRROR_MAX_GAP 4
+#else
+#define MARK_MIRROR(x, mask)
+#endif
 
 /* Initialise board - initial snake and some food. It is
 ** assumed the display is blank when this function is called.
 */
-void init_board(void) {
+void init_board(RandomType* rng) {
+	/* Nothing is on the board yet */
+	clear_layers();
+	init_walls();
+
     /* Cause the snake to be reset */
     init_snake();
     
     /* Add some food */
-    init_food();
+    init_food(rng);
 }
 
-/* Remove snake element from the board. 
-**
-** This function will turn the LED off - unless there
-** is food at that position
+/* Returns true (1) if the given x,y position is off
+** the valid board area, false(0) otherwise.
 */
-void remove_snake_element_from_board(PosnType posn) {
-	if(food_at(posn) == -1) {
-		turn_off_led_at((posn >> 4) & 0x07, posn & 0x0F);
-	}
+int8_t is_off_board(int8_t x, int8_t y) {
+    if(x < 0 || x >= BOARD_WIDTH) {
+        return 1;
+    } 
+    if(y < 0 || y >= BOARD_ROWS) {
+        return 1;
+    }
+    return 0;
 }
 
-/* Add snake element to the board.
-**
-** This function will turn on the LED at the given
-** position.
+/* Occupancy layer operations. The position must be on the board
+** (bit 7, used to mark rats, is ignored). The free cell counts
+** change when a cell goes from no layers to some layer, or back.
 */
-void add_snake_element_to_board(PosnType posn) {
-	turn_on_led_at((posn >> 4) & 0x07, posn & 0x0F);
+void set_occupied(uint8_t layer, PosnType posn) {
+	uint8_t x;
+	uint16_t mask;
+	x = (posn >> 4) & 0x07;
+	mask = 1U << (posn & 0x0F);
+
+	if(!(occupied_cells(x) & mask)) {
+		freeCells[x]--;
+		numFreeCells--;
+	}
+	boardLayers[layer][x] |= mask;
+	boardChanged = 1;
+	MARK_MIRROR(x, mask);
 }
 
-/* Remove food item from the board. 
-**
-** This function will turn the LED off - unless there
-** is a snake at that position.
-*/
-void remove_food_item_from_board(PosnType posn) {
-	if(!is_snake_at(posn)) {
-		turn_off_led_at((posn >> 4) & 0x07, posn & 0x0F);
+void clear_occupied(uint8_t layer, PosnType posn) {
+	uint8_t x;
+	uint16_t mask;
+	x = (posn >> 4) & 0x07;
+	mask = 1U << (posn & 0x0F);
+
+	if(boardLayers[layer][x] & mask) {
+		boardLayers[layer][x] &= ~mask;
+		boardChanged = 1;
+		MARK_MIRROR(x, mask);
+		if(!(occupied_cells(x) & mask)) {
+			freeCells[x]++;
+			numFreeCells++;
+		}
 	}
 }
 
-/* Add food item to the board.
-**
-** This function will turn on the LED at the given position.
-*/
-void add_food_item_to_board(PosnType posn) {
-	turn_on_led_at((posn >> 4) & 0x07, posn & 0x0F);
+void move_occupied(uint8_t fromLayer, uint8_t toLayer, PosnType posn) {
+	uint8_t x;
+	uint16_t mask;
+	x = (posn >> 4) & 0x07;
+	mask = 1U << (posn & 0x0F);
+
+	boardLayers[fromLayer][x] &= ~mask;
+	boardLayers[toLayer][x] |= mask;
+	boardChanged = 1;
+	MARK_MIRROR(x, mask);
 }
 
+void clear_layers(void) {
+	uint8_t layer;
+	uint8_t x;
+	for(layer = 0; layer < NUM_LAYERS; layer++) {
+		for(x = 0; x < BOARD_WIDTH; x++) {
+			boardLayers[layer][x] = 0;
+		}
+	}
+	for(x = 0; x < BOARD_WIDTH; x++) {
+		freeCells[x] = BOARD_ROWS;
+		MARK_MIRROR(x, (1U << BOARD_ROWS) - 1);
+	}
+	numFreeCells = BOARD_ROWS * BOARD_WIDTH;
+	boardChanged = 1;
+}
 
-/* Returns true (1) if the given x,y position is off
-** the valid board area, false(0) otherwise.
+int8_t is_occupied(uint8_t layer, PosnType posn) {
+	return (boardLayers[layer][(posn >> 4) & 0x07] & (1U << (posn & 0x0F))) != 0;
+}
+
+int8_t is_cell_occupied(PosnType posn) {
+	return (occupied_cells((posn >> 4) & 0x07) & (1U << (posn & 0x0F))) != 0;
+}
+
+uint8_t num_free_cells(void) {
+	return numFreeCells;
+}
+
+/* Skip whole board x positions using the free cell counts, then
+** find the free cell within that x position. Both loops are bounded
+** by the board size, not by what is on the board.
 */
-int8_t is_off_board(int8_t x, int8_t y) {
-    if(x < 0 || x >= BOARD_WIDTH) {
-        return 1;
-    } 
-    if(y < 0 || y >= BOARD_ROWS) {
-        return 1;
-    }
-    return 0;
+PosnType free_cell(uint8_t n) {
+	uint8_t x;
+	uint8_t y;
+	uint16_t freeMask;
+
+	x = 0;
+	while(n >= freeCells[x]) {
+		n -= freeCells[x];
+		x++;
+	}
+
+	freeMask = ~occupied_cells(x);
+	for(y = 0; ; y++) {
+		if(freeMask & (1U << y)) {
+			if(n == 0) {
+				break;
+			}
+			n--;
+		}
+	}
+	return position(x, y);
 }
 
+/* Returns the cells at board x position that are occupied on any layer */
+static uint16_t occupied_cells(uint8_t x) {
+	return boardLayers[SNAKE_LAYER][x] | boardLayers[FOOD_LAYER][x] |
+			boardLayers[RAT_LAYER][x] | boardLayers[WALL_LAYER][x];
+}
 
-/* Private functions - that access the LED display array directly */
-static void turn_on_led_at(int8_t x, int8_t y) {
-	uint8_t row;
-	uint8_t colBitPosn;
+void set_layer_level(uint8_t layer, uint8_t level) {
+	if(level > DISPLAY_MAX_LEVEL) {
+		level = DISPLAY_MAX_LEVEL;
+	}
+	layerLevels[layer] = level;
+	boardChanged = 1;
+}
 
-	row = x;
-	colBitPosn = y;
+void set_blinking_layers(uint8_t layers) {
+	blinkingLayers = layers;
+	boardChanged = 1;
+}
 
-	display[row] |= (1<<colBitPosn);
+void toggle_blink_phase(void) {
+	blinkPhase = !blinkPhase;
 }
 
-static void turn_off_led_at(int8_t x, int8_t y) {
-	uint8_t row;
-	uint8_t colBitPosn;
+/* Each bit plane of a display row is the OR of the layers at that 
+** board x position whose level has that bit set, leaving out the 
+** blinking layers while the blink phase is off.
+*/
+void compose_board(void) {
+	uint8_t x;
+	uint8_t layer;
+	uint8_t plane;
+	uint8_t phase;
+	uint8_t shownLayers;
+	uint8_t planeLayers;
+	uint16_t lit;
+	DisplayFrameType frame;	/* the back buffer */
 
-	row = x;
-	colBitPosn = y;
-	display[row] &= ~(1<<colBitPosn);
+	phase = blinkPhase;
+	if(!boardChanged && phase == composedPhase) {
+		/* The display frame is already up to date */
+		return;
+	}
+
+	shownLayers = phase ? 0xFF : ~blinkingLayers;
+	for(plane = 0; plane < DISPLAY_PLANES; plane++) {
+		/* Work out which layers are lit in this plane */
+		planeLayers = 0;
+		for(layer = 0; layer < NUM_LAYERS; layer++) {
+			if(layerLevels[layer] & (1 << plane)) {
+				planeLayers |= 1 << layer;
+			}
+		}
+		planeLayers &= shownLayers;
+
+		for(x = 0; x < BOARD_WIDTH; x++) {
+			lit = 0;
+			for(layer = 0; layer < NUM_LAYERS; layer++) {
+				if(planeLayers & (1 << layer)) {
+					lit |= boardLayers[layer][x];
+				}
+			}
+			set_display_row(frame, x, plane, lit);
+		}
+	}
+	commit_display(frame);
+	boardChanged = 0;
+	composedPhase = phase;
+}
+
+void redraw_board(void) {
+	boardChanged = 1;
 }
 
 //4209435
 void render_board(void){
+	/* The show functions mark their cells on the layers */
+	clear_layers();
 	show_food();
 	show_snake();
 	show_walls();
 }
+
+#if BOARD_MIRROR
+void set_board_mirror(uint8_t on) {
+	uint8_t x;
+	static const char blankRow[] PROGMEM = "               ";
+
+	mirrorOn = on;
+	if(on) {
+		redraw_board_mirror();
+	} else {
+		/* Wipe the mirror from the terminal */
+		for(x = 0; x <= BOARD_WIDTH + 1; x++) {
+			move_cursor(MIRROR_X, MIRROR_Y + x);
+			serial_write_P(blankRow, BOARD_ROWS);
+		}
+	}
+}
+
+uint8_t board_mirror_on(void) {
+	return mirrorOn;
+}
+
+void redraw_board_mirror(void) {
+	uint8_t x;
+	for(x = 0; x < BOARD_WIDTH; x++) {
+		mirrorDirty[x] = (1U << BOARD_ROWS) - 1;
+	}
+	mirrorBytesShown = 0;
+}
+
+void update_board_mirror(void) {
+	uint8_t x;
+	uint8_t y;
+	uint8_t start;
+	uint8_t end;
+	uint8_t i;
+	uint8_t sent;
+	uint16_t changed;
+	uint16_t runMask;
+	PosnType head;
+	char run[BOARD_ROWS];
+
+	if(!mirrorOn) {
+		return;
+	}
+
+	/* The head is drawn differently to the body, so if it has moved
+	** the old and new head cells both need redrawing
+	*/
+	head = get_snake_head_position();
+	if(head != mirrorHead) {
+		mirrorDirty[x_position(mirrorHead)] |= 1U << y_position(mirrorHead);
+		mirrorDirty[x_position(head)] |= 1U << y_position(head);
+		mirrorHead = head;
+	}
+
+	for(x = 0; x < BOARD_WIDTH; x++) {
+		changed = mirrorDirty[x];
+
+		y = 0;
+		while(y < BOARD_ROWS) {
+			if(!(changed & (1U << y))) {
+				y++;
+				continue;
+			}
+			/* Start a run here and extend it to each following
+			** changed cell that is close enough to the end of
+			** the run so far
+			*/
+			start = y;
+			end = y;
+			for(y++; y < BOARD_ROWS && y <= end + MIRROR_MAX_GAP + 1; y++) {
+				if(changed & (1U << y)) {
+					end = y;
+				}
+			}
+			y = end + 1;
+
+			runMask = 0;
+			for(i = start; i < y; i++) {
+				run[i - start] = mirror_glyph(x, i);
+				runMask |= 1U << i;
+			}
+
+			sent = try_draw_text(MIRROR_X + start, MIRROR_Y + x, run, y - start);
+			if(!sent) {
+				/* No room - the rest waits for the next update */
+				return;
+			}
+			mirrorBytes += sent;
+
+			/* The terminal now shows these cells as they are */
+			mirrorDirty[x] &= ~runMask;
+		}
+	}
+
+	if(!mirrorBytesShown) {
+		draw_mirror_bytes();
+	}
+}
+
+void end_board_mirror_tick(void) {
+	if(++mirrorTicks < MIRROR_REPORT_TICKS) {
+		return;
+	}
+	if(mirrorLastBytes != mirrorBytes) {
+		mirrorLastBytes = mirrorBytes;
+		mirrorBytesShown = 0;
+	}
+	mirrorBytes = 0;
+	mirrorTicks = 0;
+}
+
+uint16_t board_mirror_bytes(void) {
+	return mirrorLastBytes;
+}
+
+/* Show the mean bytes sent per tick over the last report period under
+** the mirror (if there's room), to 2 decimal places
+*/
+static void draw_mirror_bytes(void) {
+	char text[BOARD_ROWS];
+	uint8_t length;
+	uint16_t hundredths;
+
+	hundredths = (uint32_t)mirrorLastBytes * 100 / MIRROR_REPORT_TICKS;
+	length = format_unsigned(text, hundredths / 100);
+	hundredths %= 100;
+	text[length++] = '.';
+	text[length++] = '0' + hundredths / 10;
+	text[length++] = '0' + hundredths % 10;
+	text[length++] = ' ';
+	text[length++] = 'B';
+	text[length++] = '/';
+	text[length++] = 't';
+	text[length++] = 'i';
+	text[length++] = 'c';
+	text[length++] = 'k';
+	text[length++] = ' ';
+	if(try_draw_text(MIRROR_X, MIRROR_Y + BOARD_WIDTH + 1, text, length)) {
+		mirrorBytesShown = 1;
+	}
+}
+
+/* The character shown on the terminal for the cell at (x,y) */
+static char mirror_glyph(uint8_t x, uint8_t y) {
+	uint16_t mask;
+	mask = 1U << y;
+	if(boardLayers[SNAKE_LAYER][x] & mask) {
+		if(get_snake_head_position() == position(x, y)) {
+			return '@';
+		}
+		return 'O';
+	}
+	if(boardLayers[RAT_LAYER][x] & mask) {
+		return 'r';
+	}
+	if(boardLayers[FOOD_LAYER][x] & mask) {
+		return '*';
+	}
+	if(boardLayers[WALL_LAYER][x] & mask) {
+		return '#';
+	}
+	return '.';
+}
+#endif
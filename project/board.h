@@ -12,6 +12,7 @@
 
 #include <inttypes.h>
 #include "position.h"
+#include "food.h"
 
 /*
 ** The board is 15 rows in size with 7 columns. (The board row
@@ -20,15 +21,31 @@
 #define BOARD_ROWS 15
 #define BOARD_WIDTH 7
 
+/*
+** Occupancy layers. Each layer is a bitboard with one uint16_t per
+** board x position (x is the LED display row, y the column) -
+** bit y is set if the cell at (x,y) is occupied by something on that
+** layer. The snake, food and wall modules keep their layers up to date
+** as they change, so occupancy queries are a single mask test.
+*/
+#define SNAKE_LAYER 0
+#define FOOD_LAYER 1
+#define RAT_LAYER 2
+#define WALL_LAYER 3
+#define NUM_LAYERS 4
+
+extern uint16_t boardLayers[NUM_LAYERS][BOARD_WIDTH];
+
 /*
 ** Initialise the board. This will reset all 
 ** the variables that contain board information
 ** and place an initial snake on the board. It is 
 ** assumed the display is blank when this function
 ** is called. The initial snake and food items will
-** be added to the board.
+** be added to the board, placed using the given random
+** number generator.
 */
-void init_board(void); 
+void init_board(RandomType* rng); 
 
 /*
 ** Return true if given position (x,y) is not a valid 
@@ -37,21 +54,114 @@ void init_board(void);
 int8_t is_off_board(int8_t x, int8_t y);
 
 /*
-** Add/remove a block of the snake to the board at
-** the given (x,y) position. (Updates display.)
+** Mark/unmark the given (on board) position as occupied on
+** the given layer. (The display is updated by compose_board().)
+*/
+void set_occupied(uint8_t layer, PosnType posn);
+void clear_occupied(uint8_t layer, PosnType posn);
+
+/*
+** Move the given position from one layer to another. It must be
+** occupied on the "from" layer. (The cell stays occupied, so this
+** is cheaper than clearing one layer and then setting the other.)
+*/
+void move_occupied(uint8_t fromLayer, uint8_t toLayer, PosnType posn);
+
+/* Empty all the occupancy layers */
+void clear_layers(void);
+
+/*
+** Return true if the given (on board) position is occupied
+** on the given layer, or on any layer for is_cell_occupied().
+*/
+int8_t is_occupied(uint8_t layer, PosnType posn);
+int8_t is_cell_occupied(PosnType posn);
+
+/*
+** The free cells (those not occupied on any layer) are counted
+** per board x position as the layers change, so that we can pick
+** one without probing. num_free_cells() returns the number of
+** free cells on the board. free_cell(n) returns the position of
+** free cell n, counting from (0,0) - n must be less than
+** num_free_cells().
+*/
+uint8_t num_free_cells(void);
+PosnType free_cell(uint8_t n);
+
+/*
+** The LED display is composed from the occupancy layers - a cell is
+** lit if it is occupied on any layer, at the brightness level (see
+** led_display.h) given to that layer by set_layer_level(). To start
+** with the snake and walls are fully on, rats are dimmer and food is
+** dimmer still. (Levels above DISPLAY_MAX_LEVEL are fully on.) The
+** layers given to set_blinking_layers() (a bit per layer - none to
+** start with, or (1 << FOOD_LAYER) without brightness levels) are
+** only lit while the blink phase is on.
+** toggle_blink_phase() turns the phase on or off - it only writes one
+** byte, so it can be called from a timer interrupt. compose_board()
+** redraws the LED display frame if the layers or the blink phase have
+** changed since it last did so, and commits it so that the changes
+** are shown all at once - it should be called from the game loop.
 */
-void remove_snake_element_from_board(PosnType posn);
-void add_snake_element_to_board(PosnType posn);
+void set_layer_level(uint8_t layer, uint8_t level);
+void set_blinking_layers(uint8_t layers);
+void toggle_blink_phase(void);
+void compose_board(void);
+
+/* Make the next compose_board() redraw the display even if nothing
+** has changed (e.g. after it has been emptied) */
+void redraw_board(void);
 
 /*
-** Add/remove a food item to the board at the given
-** (x,y) position. (Updates display.)
+** Optional mirror of the board on the terminal. The top left of
+** the board is drawn at terminal column MIRROR_X, line MIRROR_Y, 
+** one line per board x position. The occupancy layer operations
+** mark each cell they change, and update_board_mirror() only sends
+** the cells that have changed since they were drawn - a cursor move
+** followed by the glyphs for each run of nearby changed cells. It
+** never waits for the serial port: cells that don't fit in the
+** output buffer are left for the next call.
+**
+** set_board_mirror() turns the mirror on (1) or off (0).
+** redraw_board_mirror() makes the next update redraw every cell
+** (e.g. after the terminal is cleared). update_board_mirror() should
+** be called from the game loop and end_board_mirror_tick() once per
+** game tick (whether or not the snake moved). The snake only moves
+** every few hundred ticks, so the bytes sent are counted over periods
+** of MIRROR_REPORT_TICKS ticks - the mean per tick over the last
+** period is shown under the mirror, and board_mirror_bytes() returns
+** the bytes sent during it.
+**
+** The mirror takes 22 bytes of RAM. It can be left out by building
+** with -DBOARD_MIRROR=0, and the functions then do nothing.
 */
-void remove_food_item_from_board(PosnType posn);
-void add_food_item_to_board(PosnType posn);
+#ifndef BOARD_MIRROR
+#define BOARD_MIRROR 1
+#endif
+
+#define MIRROR_X 50
+#define MIRROR_Y 5
+#define MIRROR_REPORT_TICKS 250	/* half a second (at most 255) */
+
+#if BOARD_MIRROR
+void set_board_mirror(uint8_t on);
+uint8_t board_mirror_on(void);
+void redraw_board_mirror(void);
+void update_board_mirror(void);
+void end_board_mirror_tick(void);
+uint16_t board_mirror_bytes(void);
+#else
+#define set_board_mirror(on)
+#define board_mirror_on() 0
+#define redraw_board_mirror()
+#define update_board_mirror()
+#define end_board_mirror_tick()
+#define board_mirror_bytes() 0
+#endif
 
 //4209435
-/* redraws the board after it has been cleared */
+/* rebuilds the occupancy layers from the snake, food and walls,
+** so the next compose_board() redraws the whole display */
 void render_board(void);
 
 #endif
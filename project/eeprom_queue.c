@@ -0,0 +1,201 @@
+/*
+** eeprom_queue.c
+**
+** Background EEPROM writes, driven by the HAL's EEPROM ready calls.
+*/
+
+#include "hal.h"
+#include "eeprom_queue.h"
+
+#if (EEPROM_QUEUE_SIZE & (EEPROM_QUEUE_SIZE - 1)) || EEPROM_QUEUE_SIZE > 128
+#error "EEPROM_QUEUE_SIZE must be a power of 2 no greater than 128"
+#endif
+
+#if EEPROM_DATA_SIZE > 255
+#error "EEPROM_DATA_SIZE must be no greater than 255"
+#endif
+
+typedef struct {
+	uint16_t address;
+	uint8_t length;
+} EepromSpanType;
+
+/*
+** Circular buffer of spans. ee_head counts spans queued and is only
+** written by non-ISR code, ee_tail counts spans finished and is only
+** written by the ISR (which also works through the span at the tail).
+** Both wrap around at 256, so (ee_head - ee_tail) is the number of
+** spans waiting. The span at the head is the one being built (by
+** eeprom_queue_start() and eeprom_queue_put()).
+**
+** The bytes of the spans are kept, in order, in the circular buffer
+** ee_data. The ISR takes them from ee_dataOut, and the span being
+** built puts them after ee_dataIn. ee_pending (the number of bytes
+** queued) is changed by both, so non-ISR code changes it with
+** interrupts off. It is a single byte, so it can be read at any time
+** - the ISR only ever makes it smaller.
+*/
+EepromSpanType ee_queue[EEPROM_QUEUE_SIZE];
+volatile uint8_t ee_head;
+volatile uint8_t ee_tail;
+uint8_t ee_data[EEPROM_DATA_SIZE];
+uint8_t ee_dataIn;
+uint8_t ee_dataOut;
+volatile uint8_t ee_pending;
+
+/* Functions available within this file */
+static void start_span(uint16_t address);
+
+void init_eeprom_queue(void) {
+	ee_head = 0;
+	ee_tail = 0;
+	ee_dataIn = 0;
+	ee_dataOut = 0;
+	ee_pending = 0;
+	hal_eeprom_ready_interrupt(0);
+}
+
+uint8_t eeprom_queue_write(void* address, const void* source, uint8_t length) {
+	const uint8_t* data = (const uint8_t*)source;
+
+	/* Only queue it if it fits, so that nothing waits */
+	if(length > EEPROM_DATA_SIZE - ee_pending ||
+			(uint8_t)(ee_head - ee_tail) >= EEPROM_QUEUE_SIZE) {
+		return 0;
+	}
+	eeprom_queue_start(address);
+	while(length--) {
+		eeprom_queue_put(*data++);
+	}
+	eeprom_queue_finish();
+	return 1;
+}
+
+void eeprom_queue_start(void* address) {
+	start_span(HAL_EEPROM_ADDRESS(address));
+}
+
+void eeprom_queue_put(uint8_t data) {
+	EepromSpanType* span = &ee_queue[ee_head & (EEPROM_QUEUE_SIZE - 1)];
+	uint16_t address;
+	uint8_t index;
+
+	if(span->length >= EEPROM_DATA_SIZE - ee_pending) {
+		/* The queue is full - queue what we have, wait for room
+		** and carry on in a new span
+		*/
+		address = span->address + span->length;
+		eeprom_queue_finish();
+		while(ee_pending >= EEPROM_DATA_SIZE) {
+			; /* do nothing */
+		}
+		start_span(address);
+		span = &ee_queue[ee_head & (EEPROM_QUEUE_SIZE - 1)];
+	}
+	index = ee_dataIn + span->length;
+	if(index >= EEPROM_DATA_SIZE) {
+		index -= EEPROM_DATA_SIZE;
+	}
+	ee_data[index] = data;
+	span->length++;
+}
+
+void eeprom_queue_finish(void) {
+	EepromSpanType* span = &ee_queue[ee_head & (EEPROM_QUEUE_SIZE - 1)];
+	uint8_t interrupts_on;
+
+	if(span->length == 0) {
+		return;
+	}
+	ee_dataIn += span->length;
+	if(ee_dataIn >= EEPROM_DATA_SIZE) {
+		ee_dataIn -= EEPROM_DATA_SIZE;
+	}
+
+	/* Publish the span and make sure the ISR is running */
+	interrupts_on = hal_interrupts_off();
+	ee_pending += span->length;
+	ee_head++;
+	hal_eeprom_ready_interrupt(1);
+	hal_interrupts_restore(interrupts_on);
+}
+
+uint8_t eeprom_queue_room(void) {
+	if((uint8_t)(ee_head - ee_tail) >= EEPROM_QUEUE_SIZE) {
+		return 0;
+	}
+	return EEPROM_DATA_SIZE - ee_pending;
+}
+
+uint8_t eeprom_pending_bytes(void) {
+	return ee_pending;
+}
+
+uint8_t eeprom_queue_idle(void) {
+	/* The last byte may still be being written */
+	return ee_head == ee_tail && !hal_eeprom_busy();
+}
+
+void eeprom_queue_wait(void) {
+	while(!eeprom_queue_idle()) {
+		; /* do nothing */
+	}
+}
+
+/*
+** The HAL calls this (with interrupts off) whenever the EEPROM is 
+** ready for a write, while the queue isn't empty. We work through the span at the tail of
+** the queue, reading each byte back first and skipping it if it
+** already holds the right value, until we start writing a byte. At 
+** most EEPROM_MAX_SKIP bytes are checked each time, so the time spent
+** here is bounded - if we haven't started a write by then, we are
+** called again and carry on. The calls are turned off once the queue
+** is empty.
+*/
+void eeprom_queue_ready(void) {
+	EepromSpanType* span;
+	uint8_t data;
+	uint8_t checked;
+	uint8_t changed;
+
+	for(checked = 0; checked < EEPROM_MAX_SKIP; checked++) {
+		if(ee_tail == ee_head) {
+			hal_eeprom_ready_interrupt(0);
+			return;
+		}
+		span = &ee_queue[ee_tail & (EEPROM_QUEUE_SIZE - 1)];
+		data = ee_data[ee_dataOut];
+		if(++ee_dataOut == EEPROM_DATA_SIZE) {
+			ee_dataOut = 0;
+		}
+
+		changed = (hal_eeprom_read(span->address) != data);
+		if(changed) {
+			hal_eeprom_write(span->address, data);
+		}
+
+		span->address++;
+		ee_pending--;
+		if(--span->length == 0) {
+			ee_tail++;
+		}
+		if(changed) {
+			/* Wait for the write to finish */
+			return;
+		}
+	}
+}
+
+/* Start building a span at the head of the queue, waiting for the
+** span to be free if the queue is full
+*/
+static void start_span(uint16_t address) {
+	EepromSpanType* span;
+
+	while((uint8_t)(ee_head - ee_tail) >= EEPROM_QUEUE_SIZE) {
+		; /* do nothing */
+	}
+	span = &ee_queue[ee_head & (EEPROM_QUEUE_SIZE - 1)];
+	span->address = address;
+	span->length = 0;
+}
@@ -0,0 +1,90 @@
+/*
+** eeprom_queue.h
+**
+** Queue of EEPROM writes which are done in the background, one byte
+** at a time whenever the EEPROM is ready (each byte takes about 4ms
+** to write). The AT90S8515 has no EEPROM ready interrupt, so the HAL
+** checks for this on each 2ms tick. Bytes that already hold the
+** value being written are read back and skipped, which only takes a
+** few cycles - so rewriting a block that has hardly changed is quick
+** and causes little EEPROM wear. A write is a span of bytes to
+** EEPROM. The bytes are copied into the queue when the write is
+** queued, so the caller is free to change its own copy straight away
+** and needs no buffer of its own - a write can be built up a byte at
+** a time with eeprom_queue_start(), eeprom_queue_put() and
+** eeprom_queue_finish(). Spans are written in the order they were
+** queued.
+**
+** The queue is a single-producer/single-consumer ring: writes must
+** only be queued from non-ISR code. Nothing else may write to the
+** EEPROM (e.g. with eeprom_write_byte()) while writes are queued, and
+** EEPROM that is still to be written should not be read - call
+** eeprom_queue_wait() first.
+*/
+
+/* Guard band to ensure this definition is only included once */
+#ifndef EEPROM_QUEUE_H
+#define EEPROM_QUEUE_H
+
+#include <inttypes.h>
+
+/* Number of spans that can be waiting to be written. Must be a power
+** of 2 no greater than 128.
+*/
+#define EEPROM_QUEUE_SIZE 4
+
+/* Number of bytes that can be waiting to be written (in all the
+** spans), at most 255. Each byte takes a byte of RAM, so this is kept
+** small - a longer write built up a byte at a time waits for room,
+** unless it is queued in parts (see eeprom_queue_room()). It must
+** still hold the longest write that is queued with
+** eeprom_queue_write() (a recording event or a high score slot).
+*/
+#define EEPROM_DATA_SIZE 8
+
+/* The most bytes the interrupt handler will check (and skip if they
+** are unchanged) each time it is called
+*/
+#define EEPROM_MAX_SKIP 8
+
+void init_eeprom_queue(void);
+
+/*
+** Queue a write of length bytes from source (in RAM) to address (in
+** EEPROM). Returns 1 if the write was queued, 0 if there isn't room
+** for it (in which case nothing is written).
+*/
+uint8_t eeprom_queue_write(void* address, const void* source, uint8_t length);
+
+/*
+** Build up a write a byte at a time: eeprom_queue_start() starts a
+** write to address (in EEPROM), each eeprom_queue_put() adds the next
+** byte and eeprom_queue_finish() queues the rest of the write. If the
+** queue fills up, the bytes put so far are queued and these wait
+** until there is room for more - so the write can be any length, but
+** interrupts must be enabled (see eeprom_queue_wait()).
+*/
+void eeprom_queue_start(void* address);
+void eeprom_queue_put(uint8_t data);
+void eeprom_queue_finish(void);
+
+/* Returns the number of bytes that can be queued now without waiting
+** (0 if every span is in use) - a write of at most this many bytes,
+** started with eeprom_queue_start(), is queued without waiting. A
+** long write can be queued this many bytes at a time, so that nothing
+** waits for the EEPROM.
+*/
+uint8_t eeprom_queue_room(void);
+
+/* Returns the number of bytes queued but not yet written (or skipped) */
+uint8_t eeprom_pending_bytes(void);
+
+/* Returns true if all the queued writes have finished */
+uint8_t eeprom_queue_idle(void);
+
+/* Wait until all the queued writes have finished. Interrupts must
+** be enabled (and the timer started - see init_timer()).
+*/
+void eeprom_queue_wait(void);
+
+#endif
@@ -0,0 +1,114 @@
+/*
+** events.c
+**
+** Queue of events posted from ISRs and handled from the main loop,
+** and the game timers that post them.
+*/
+
+#include "events.h"
+#include "timer.h"
+#include "game.h"
+#include "board.h"
+#include "led_display.h"
+
+/* Without brightness levels food is told apart by making it blink 5
+** times a second, so the blink phase is toggled every 100ms
+*/
+#define BLINK_PERIOD 100
+
+/*
+** The events posted and taken of each kind. eventsPosted is only
+** written by the producer (ISR code), eventsTaken only by the
+** consumer (the main loop). Both wrap around at 256, so
+** (eventsPosted[k] - eventsTaken[k]) is the number of events of kind
+** k waiting. Each count is a single byte, so the other side can read
+** it at any time.
+*/
+volatile uint8_t eventsPosted[NUM_EVENTS];
+volatile uint8_t eventsTaken[NUM_EVENTS];
+volatile uint8_t event_overrun;
+
+/* The software timers of the game (0 if not running) */
+static uint8_t gameTimerNum;
+#if !DISPLAY_BAM
+static uint8_t blinkTimerNum;
+#endif
+
+static void post_game_tick(void);
+
+void init_events(void) {
+	uint8_t event;
+
+	for(event = 0; event < NUM_EVENTS; event++) {
+		eventsPosted[event] = 0;
+		eventsTaken[event] = 0;
+	}
+	event_overrun = 0;
+}
+
+uint8_t post_event(uint8_t event) {
+	uint8_t posted = eventsPosted[event];
+	if((uint8_t)(posted - eventsTaken[event]) == 255) {
+		event_overrun = 1;
+		return 0;
+	}
+	eventsPosted[event] = posted + 1;
+	return 1;
+}
+
+uint8_t get_event(void) {
+	uint8_t event;
+	uint8_t taken;
+
+	for(event = 0; event < NUM_EVENTS; event++) {
+		taken = eventsTaken[event];
+		if(taken != eventsPosted[event]) {
+			eventsTaken[event] = taken + 1;
+			return event;
+		}
+	}
+	return EVENT_NONE;
+}
+
+void flush_events(void) {
+	uint8_t event;
+
+	for(event = 0; event < NUM_EVENTS; event++) {
+		eventsTaken[event] = eventsPosted[event];
+	}
+}
+
+void start_game_timers(void) {
+#if !DISPLAY_BAM
+	/* Toggling the blink phase only writes a byte, so it is done
+	** from the timer directly
+	*/
+	blinkTimerNum = execute_function_periodically(BLINK_PERIOD,
+			toggle_blink_phase);
+#endif
+	gameTimerNum = execute_function_periodically(GAME_TICK_PERIOD,
+			post_game_tick);
+}
+
+void stop_game_timers(void) {
+	/* Forget the timer numbers as well - once cancelled they can be
+	** given to someone else (e.g. the sound), who a second stop
+	** would otherwise cancel
+	*/
+#if !DISPLAY_BAM
+	cancel_software_timer(blinkTimerNum);
+	blinkTimerNum = 0;
+#endif
+	cancel_software_timer(gameTimerNum);
+	gameTimerNum = 0;
+	flush_events();
+}
+
+/* The game timer callback. This runs from the timer ISR, so it just
+** posts the tick - the main loop steps the game. If 255 ticks are
+** waiting (510ms behind) the rest are lost, which slows the game down
+** rather than losing track of it.
+*/
+static void post_game_tick(void) {
+	post_event(EVENT_GAME_TICK);
+}
@@ -0,0 +1,73 @@
+/*
+** events.h
+**
+** Events posted by the game timers (from the timer interrupt) and
+** handled by the main loop. The timer callbacks only post an event -
+** the work for it is done by the main loop, so the ISR stays short and
+** the game state is only ever changed from the main loop.
+**
+** Every event of a kind is the same, so rather than a ring of event
+** IDs the queue keeps, for each kind, a count of the events posted
+** and a count of the events taken. It is still a single-producer/
+** single-consumer queue: the ISR only writes the posted counts and the
+** main loop only writes the taken counts, so neither side turns
+** interrupts off. Events of different kinds may be taken in a
+** different order to the one they were posted in.
+*/
+
+/* Guard band to ensure this definition is only included once */
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <inttypes.h>
+
+/* Event kinds, and the value get_event() returns if there are none */
+#define EVENT_GAME_TICK 0
+#define NUM_EVENTS 1
+#define EVENT_NONE 0xFF
+
+/*
+** Set when an event is posted while 255 of its kind are waiting (and
+** lost). We never clear this flag - it's up to the programmer to
+** check/clear it.
+*/
+extern volatile uint8_t event_overrun;
+
+/* init_events()
+**
+** Empty the event queue.
+*/
+void init_events(void);
+
+/* post_event(event)
+**
+** Add an event of the given kind to the queue. Returns 1 if
+** successful, 0 if it was lost. (ISR code only.)
+*/
+uint8_t post_event(uint8_t event);
+
+/* get_event()
+**
+** Remove and return the kind of an event waiting in the queue, or
+** EVENT_NONE if the queue is empty. (Non-ISR code only.)
+*/
+uint8_t get_event(void);
+
+/* flush_events()
+**
+** Throw away all the events waiting in the queue. (Non-ISR code
+** only.)
+*/
+void flush_events(void);
+
+/* start_game_timers() / stop_game_timers()
+**
+** Start the timers that run the game - one posts an EVENT_GAME_TICK
+** every GAME_TICK_PERIOD (see game.h), and without brightness levels
+** another blinks the food (see toggle_blink_phase() in board.h).
+** Stopping them also flushes the events that haven't been taken.
+*/
+void start_game_timers(void);
+void stop_game_timers(void);
+
+#endif
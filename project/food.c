@@ -18,7 +18,7 @@
 #include "led_display.h"
 #include "terminalio.h"
 #include <stdio.h>
-#include <avr/pgmspace.h>
+#include "hal.h"
 //
 
 /*
@@ -34,20 +34,27 @@ PosnType foodPositions[MAX_FOOD];
 int8_t currRatDirection[2];
 int8_t numFoodItems;
 
+/* Returned by rat_step() when a rat can't move in a direction */
+#define NO_RAT_STEP 0xFF
+
+/* Functions available within this file */
+static PosnType rat_step(PosnType ratPosition, int8_t direction);
+static uint8_t food_layer(PosnType foodPosition);
+
 /* 
 ** Initialise food details - three to start with. (It is assumed
 ** that only the snake is on the display before this.)
 */
-void init_food(void) {
+void init_food(RandomType* rng) {
 	numFoodItems = 0;
      
     /* Add some food */
-    add_food_items(3);
+    add_food_items(3, rng);
 
 	//4209435
 	/* Transform some food to rats */
-	food_to_rat();
-	food_to_rat();
+	food_to_rat(rng);
+	food_to_rat(rng);
 }
 
 /* Returns a food ID if there is food at the given position,
@@ -55,6 +62,12 @@ void init_food(void) {
 */
 int8_t food_at(PosnType posn) {
     int8_t id;
+	/* Most positions have no food - the layers tell us that
+	** straight away. Otherwise look up the ID.
+	*/
+	if(!is_occupied(FOOD_LAYER, posn) && !is_occupied(RAT_LAYER, posn)) {
+		return -1;
+	}
     for(id=0; id < numFoodItems; id++) {
         if(foodPositions[id] == (posn | 0x80) || foodPositions[id] == posn) {
             /* Food found at this position */
@@ -69,76 +82,38 @@ int8_t food_at(PosnType posn) {
 /* Attempt to add food items. Returns 
 ** the number of items actually positioned. (We may place
 ** fewer than the number requested because (a) we ran out
-** of space to store them, or (b) we can't find space on
-** the board for them.)
+** of space to store them, or (b) there are no free cells
+** on the board.)
 */
-int8_t add_food_items(int8_t num) {
-    /* Generate random positions until we get one
-    ** at which there is no snake and no existing
-    ** food.
-    */
-    int8_t x, y, i, attempts;
-    x = 0;
-	y = 0;
+int8_t add_food_items(int8_t num, RandomType* rng) {
+    int8_t i;
+    PosnType posn;
     for(i=0; i < num; i++) {
         /* First check that we have space in our list
-        ** of food items to hold another one. If not, 
-        ** just return.
+        ** of food items to hold another one, and somewhere
+        ** to put it. If not, just return.
         */
-        if(numFoodItems >= MAX_FOOD) {
+        if(numFoodItems >= MAX_FOOD || num_free_cells() == 0) {
             /* Number we've managed to add is i */
             return i;
         }
         
-        /* Make some attempts to position 
-        ** some food. (We don't try forever - just
-        ** in case the board is filled.) We start
-		** at (0,0) and generate a series of 
-		** positions.
-        */
-        attempts = 0;
-	
-        do {
-            x = (x+2)%BOARD_WIDTH;
-            y = (y+2)%BOARD_ROWS;
-            attempts++;
-        } while(
-				attempts < 100 && 
-                (
-					is_snake_at(
-						((x & 0x0F) << 4 ) | (y & 0x0F)
-					) || 
-					food_at(
-						((x & 0x0F) << 4) | (y & 0x0F)
-					) != -1 || 
-					is_wall_at(
-					((x & 0x0F) << 4) | (y & 0x0F)
-					)
-				)
-			);
-        
-        if(attempts >= 100) {
-            /* We tried 100 times to generate a position
-            ** but they were all occupied.
-            */
-            return i;
-        }
-        
-        /* Now have an x,y position where we can put
-        ** food. (There is no food or snake at this position.)
+        /* Pick one of the free cells at random. (There is no
+        ** food, snake or wall at this position.)
         */
-        foodPositions[numFoodItems] = ((x & 0x0F) << 4) | (y & 0x0F);
+        posn = free_cell(random_below(&rng->food, num_free_cells()));
+        foodPositions[numFoodItems] = posn;
         numFoodItems++;
-        add_food_item_to_board(((x & 0x0F) << 4) | (y & 0x0F));
+        set_occupied(FOOD_LAYER, posn);
     }
     return num;
 }
 
 /*
 ** Remove the food item from our list of food (and
-** from the display if there is no snake at that position)
+** from the board layers, which the display is composed from)
 */
-void remove_food(int8_t foodID) {
+void remove_food(int8_t foodID, RandomType* rng) {
     int8_t i;
         
     if(foodID < 0 || foodID >= numFoodItems) {
@@ -147,20 +122,19 @@ void remove_food(int8_t foodID) {
     }
 
 	//add food
-	add_food_items(1);
+	add_food_items(1, rng);
     //player must have eaten the food, update score
 	if(foodPositions[foodID] & 0x80){
 		add_to_score(10);
 		//add another rat
-		food_to_rat();
+		food_to_rat(rng);
 	}
 	else
 		add_to_score(5);
 	
-	update_score();
-    /* Remove the food from the display.
+    /* Remove the food from the board (and so the display).
     */
-	remove_food_item_from_board(foodPositions[foodID] & 0x7F);
+	clear_occupied(food_layer(foodPositions[foodID]), foodPositions[foodID]);
      
     /* Shuffle our list of food items along so there are
 	** no holes in our list 
@@ -175,58 +149,27 @@ void remove_food(int8_t foodID) {
 void show_food(void) {
 	int8_t i;
 	for(i=0; i < numFoodItems; i++) {
-		add_food_item_to_board(foodPositions[i]);
-	}
-}
-
-//4209435
-void hide_food(void) {
-	int8_t i;
-	//first two foods are always rats
-	for(i=2; i < numFoodItems; i++) {
-		remove_food_item_from_board(foodPositions[i]);
-
-		/* for debug
-		move_cursor(1,20);
-		printf_P(PSTR("Food Positions:"));
-		int8_t i;
-		for(i = 0; i < MAX_SNAKE_SIZE; i++)	
-			printf_P(PSTR(" %u"), foodPositions[i] );
-		*/	
+		set_occupied(food_layer(foodPositions[i]), foodPositions[i]);
 	}
 }
 
 //4209435
-void blink_food(void){
-	/*
-	** status = 0, light is on
-	** status = 1, light is off
-	*/
-	static uint8_t status = 0;
-
-	if(status) {
-		show_food();
-		status = 0;
-	}
-	else {
-		hide_food();
-		status = 1;
-	}
-}
-
-//4209435
-void food_to_rat(void){
+void food_to_rat(RandomType* rng){
 	//make the first two food items always rats
 	//try to make the first a rat
 	//if it is already, make the second a rat
 	//Note: take advantage of the fact that maxX is 6
 	if(!(foodPositions[0] & 0x80)){
+		clear_occupied(FOOD_LAYER, foodPositions[0]);
 		foodPositions[0] |= 0x80;
-		currRatDirection[0] = rand2(256) % 4;
+		set_occupied(RAT_LAYER, foodPositions[0]);
+		currRatDirection[0] = random_below(&rng->rats, 4);
 	}
 	else{
+		clear_occupied(FOOD_LAYER, foodPositions[1]);
 		foodPositions[1] |= 0x80;	
-		currRatDirection[1] = rand2(256) % 4;
+		set_occupied(RAT_LAYER, foodPositions[1]);
+		currRatDirection[1] = random_below(&rng->rats, 4);
 	}
 		
 
@@ -236,43 +179,36 @@ void food_to_rat(void){
 	//*/
 }
 
-void move_rats(void){
+/* Move each rat one step in a random direction. If the new
+** position is off the board or already occupied, the rat turns
+** around; if that is blocked too, it stays where it is.
+*/
+void move_rats(RandomType* rng){
 	int8_t i;
-	int8_t direction = 0;
-	int8_t ratMask;
+	int8_t direction;
 	PosnType ratPosition;
+	PosnType newPosition;
 
-	for(i = 0; i < 2; i++){
+	for(i = 0; i < 2 && i < numFoodItems; i++){
 		ratPosition = foodPositions[i];
-		ratMask = ratPosition & 0x7F;
-		direction = rand2(65000) % 4;
-		
-		remove_food_item_from_board(ratPosition);
-		switch(direction){
-			case UP:
-				ratPosition += 0x01;
-				if(( ratPosition & 0x0F) >= BOARD_ROWS || is_snake_at(ratMask) || food_at((ratMask) + 0x01) != -1 || is_wall_at((ratMask) + 0x01))
-					ratPosition = reverse_direction(UP, i);
-				break;
-			case DOWN:
-				ratPosition -= 0x01;
-				if((ratPosition & 0x0F) <= 0 || is_snake_at(ratMask) || food_at((ratMask) - 0x01) != -1 || is_wall_at((ratMask) + 0x01))
-					ratPosition = reverse_direction(DOWN, i);
-				break;
-			case LEFT:
-					ratPosition -= 0x10;
-				if((ratPosition & 0x70) <= 0 || is_snake_at(ratMask) || food_at((ratMask) - 0x10) != -1 || is_wall_at((ratMask) + 0x01))
-					ratPosition = reverse_direction(LEFT, i);
-				break;
-			case RIGHT:
-				ratPosition += 0x10;
-				if(((ratPosition>>4) & 0x07) >= BOARD_WIDTH - 1 || is_snake_at(ratMask) || food_at((ratMask) + 0x10) != -1 || is_wall_at((ratMask) + 0x01))
-					ratPosition = reverse_direction(RIGHT, i);
-				break;
+		if(!(ratPosition & 0x80)) {
+			/* Not a rat */
+			continue;
+		}
+		direction = random_below(&rng->rats, 4);
+
+		newPosition = rat_step(ratPosition, direction);
+		if(newPosition == NO_RAT_STEP) {
+			direction = reverse_direction(direction);
+			newPosition = rat_step(ratPosition, direction);
 		}
-		
 		currRatDirection[i] = direction;
-		foodPositions[i] = ratPosition;
+
+		if(newPosition != NO_RAT_STEP) {
+			clear_occupied(RAT_LAYER, ratPosition);
+			foodPositions[i] = newPosition | 0x80;
+			set_occupied(RAT_LAYER, newPosition);
+		}
 
 	/*for debugging *
 	move_cursor(1,16);
@@ -281,38 +217,42 @@ void move_rats(void){
 	}
 }
 
-PosnType reverse_direction(int8_t direction, int8_t i){
-	int8_t currDirection;
-	PosnType ratPosition;
-	currDirection = currRatDirection[i];
-	ratPosition = foodPositions[i];
+int8_t reverse_direction(int8_t direction){
+	return (direction + 2) % 4;
+}
+
+/* Returns the position one step from the given rat position in
+** the given direction, or NO_RAT_STEP if that is off the board or
+** occupied.
+*/
+static PosnType rat_step(PosnType ratPosition, int8_t direction){
+	int8_t x;
+	int8_t y;
+	x = x_position(ratPosition);
+	y = y_position(ratPosition);
 
 	switch(direction){
 		case UP:
-				currDirection = DOWN;
-				ratPosition -= 0x01;
+			y++;
 			break;
 		case DOWN:
-				currDirection = UP;
-				ratPosition += 0x01;
+			y--;
 			break;
 		case LEFT:
-				currDirection = RIGHT;
-				ratPosition += 0x10;
+			x--;
 			break;
 		case RIGHT:
-				currDirection = LEFT;
-				ratPosition -= 0x10;
+			x++;
 			break;
 	}
-		
-	currRatDirection[i] = direction;
-	return ratPosition;
+
+	if(is_off_board(x, y) || is_cell_occupied(position(x, y))) {
+		return NO_RAT_STEP;
+	}
+	return position(x, y);
 }
 
-/* http://www.daniweb.com/code/snippet216329.html by "vegaseat" */
-uint16_t rand2(uint16_t lim){
-    static uint16_t a = 1;  // could be made the seed value
-	a = (a * 32719 + 3) % 32749;
-	return ((a % lim) + 1);
+/* Returns the occupancy layer a food item lives on */
+static uint8_t food_layer(PosnType foodPosition){
+	return (foodPosition & 0x80) ? RAT_LAYER : FOOD_LAYER;
 }
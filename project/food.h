@@ -12,7 +12,7 @@
 
 #include <inttypes.h>
 #include "position.h"
-
+#include "random.h"
 
 /* Maximum number of food items that can be on the board
 ** at any one time.
@@ -28,7 +28,7 @@
 ** Initialise the food details and add a few items of food
 ** (and display them).
 */
-void init_food(void); 
+void init_food(RandomType* rng); 
 
 /* food_at(position)
 ** 
@@ -46,10 +46,11 @@ int8_t food_at(PosnType posn);
 ** Attempt to add food items. Returns 
 ** the number of items actually added. (We may add
 ** fewer than the number requested because (a) we ran out
-** of space to store them, or (b) we can't find space on
-** the board for them.) Food items are displayed.
+** of space to store them, or (b) there are no free cells
+** on the board.) Food items are placed in random free
+** cells and displayed.
 */
-int8_t add_food_items(int8_t numberItems);
+int8_t add_food_items(int8_t numberItems, RandomType* rng);
 
 /* remove_food(foodID)
 **
@@ -57,25 +58,21 @@ int8_t add_food_items(int8_t numberItems);
 ** change the IDs of other food items. The food item is
 ** removed from the display.
 */
-void remove_food(int8_t foodID);
+void remove_food(int8_t foodID, RandomType* rng);
 
 /* 42094353 show_food(void)
 **
-** Display all the food on the board
+** Mark all the food (and rats) on the board layers. (Food
+** blinks because its layer is composed with the blink phase -
+** see board.h.)
 */
 void show_food(void);
 
-void hide_food(void);
-
-void blink_food(void);
-
-void food_to_rat(void);
-
-void move_rats(void);
+void food_to_rat(RandomType* rng);
 
-PosnType reverse_direction(int8_t, int8_t);
+void move_rats(RandomType* rng);
 
-/* http://www.daniweb.com/code/snippet216329.html by "vegaseat" */
-uint16_t rand2(uint16_t);
+/* Returns the direction opposite to the given direction */
+int8_t reverse_direction(int8_t);
 
 #endif
@@ -0,0 +1,86 @@
+/*
+** game.c
+**
+** The game core - see game.h.
+*/
+
+#include "game.h"
+#include "board.h"
+#include "snake.h"
+#include "food.h"
+#include "wall.h"
+#include "score.h"
+
+void game_configure(GameState* state) {
+	state->movePeriod = GAME_TICKS(GAME_MOVE_PERIOD);
+	state->ratPeriod = GAME_TICKS(GAME_RAT_PERIOD);
+	state->wallPeriod = GAME_TICKS(WALL_TICK_PERIOD);
+	state->recording = NULL;
+}
+
+void game_new(GameState* state, RandomType* rng, uint32_t seed) {
+	random_seed(rng, seed);
+	init_board(rng);
+	reset_score();
+	game_init(state);
+	if(state->recording) {
+		record_start(state->recording, seed, state->movePeriod,
+				state->ratPeriod, state->wallPeriod);
+	}
+}
+
+void game_init(GameState* state) {
+	state->moveCountdown = state->movePeriod;
+	state->ratCountdown = state->ratPeriod;
+	state->wallCountdown = state->wallPeriod;
+	state->tick = 0;
+	state->status = MOVE_OK;
+	if(state->recording) {
+		record_clear(state->recording);
+	}
+}
+
+int8_t game_step(GameState* state, int8_t input, RandomType* rng) {
+	int8_t result = 0;
+
+	if(state->status < 0) {
+		/* Game over */
+		return state->status;
+	}
+	if(state->recording && input >= UP && input <= GAME_MOVE_NOW) {
+		record_input(state->recording, state->tick, input);
+	}
+	state->tick++;
+
+	if(input >= UP && input <= LEFT) {
+		set_snake_dirn(input);
+	}
+
+	/* A move made straight away doesn't change when the next timed
+	** move happens
+	*/
+	if(--state->moveCountdown == 0) {
+		state->moveCountdown = state->movePeriod;
+		input = GAME_MOVE_NOW;
+	}
+	if(input == GAME_MOVE_NOW) {
+		result = move_snake(rng);
+		state->status = result;
+		if(result < 0) {
+			if(state->recording) {
+				record_end(state->recording, state->tick);
+			}
+			return result;
+		}
+	}
+
+	if(--state->ratCountdown == 0) {
+		state->ratCountdown = state->ratPeriod;
+		move_rats(rng);
+	}
+	if(--state->wallCountdown == 0) {
+		state->wallCountdown = state->wallPeriod;
+		expire_walls();
+	}
+	return result;
+}
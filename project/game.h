@@ -0,0 +1,88 @@
+/*
+** game.h
+**
+** The game core. game_step() advances the game by one tick - it
+** moves the snake and the rats and expires the walls when they are
+** due - and does no I/O. The board, snake, food and wall modules hold
+** the pieces on the board (there is only ever one game, and no RAM
+** for copies of it); GameState holds the game clock. The firmware
+** calls game_step() every 2ms and draws the board as it changes. A
+** host program can call it as fast as it likes, with no drawing at
+** all.
+*/
+
+/* Guard band to ensure this definition is only included once */
+#ifndef GAME_H
+#define GAME_H
+
+#include <inttypes.h>
+#include "random.h"
+#include "record.h"
+
+/* The length of a tick (ms), and the default times between moves of
+** the snake and of the rats (ms). (Walls are expired every
+** WALL_TICK_PERIOD ms - see wall.h.)
+*/
+#define GAME_TICK_PERIOD 2
+#define GAME_MOVE_PERIOD 500
+#define GAME_RAT_PERIOD 922
+
+/* Converts ms to ticks (rounding up) */
+#define GAME_TICKS(ms) (((ms) + GAME_TICK_PERIOD - 1) / GAME_TICK_PERIOD)
+
+/* Inputs to game_step(). UP, RIGHT, DOWN and LEFT (see snake.h) turn
+** the snake, GAME_MOVE_NOW moves it straight away.
+*/
+#define GAME_NO_INPUT -1
+#define GAME_MOVE_NOW 4
+
+typedef struct {
+	/* The number of ticks between moves of the snake, moves of the
+	** rats and ticks of the wall clock. game_configure() sets the
+	** defaults - they can be changed (to at least 1) before
+	** game_init().
+	*/
+	uint16_t movePeriod;
+	uint16_t ratPeriod;
+	uint16_t wallPeriod;
+
+	/* The number of ticks until each of those next happens */
+	uint16_t moveCountdown;
+	uint16_t ratCountdown;
+	uint16_t wallCountdown;
+
+	/* Ticks since the game started */
+	uint32_t tick;
+
+	/* The result of the last move of the snake (see move_snake()) -
+	** the game is over if it is negative
+	*/
+	int8_t status;
+
+	/* The recording the game is recorded in (see record.h), or NULL */
+	RecordingType* recording;
+} GameState;
+
+/* Set the default periods, with no recording */
+void game_configure(GameState* state);
+
+/* game_new() starts a new game - the random number generator seeded
+** with the given seed, a new board placed using it, score 0, and the
+** clock started with game_init(). game_init() only starts the clock,
+** for the game already on the board (e.g. one that has just been
+** loaded). Only a game
+** started by game_new() is recorded - game_init() empties the
+** recording, since the game already on the board can't be replayed.
+*/
+void game_new(GameState* state, RandomType* rng, uint32_t seed);
+void game_init(GameState* state);
+
+/* Advance the game by one tick, after acting on the input (or
+** GAME_NO_INPUT). Returns the result of moving the snake (see
+** move_snake()), or 0 if it didn't move this tick. Nothing happens
+** once the game is over - the (negative) result of the move that
+** ended it is returned. The game over is the end of the recording.
+*/
+int8_t game_step(GameState* state, int8_t input, RandomType* rng);
+
+#endif
@@ -0,0 +1,110 @@
+/*
+** hal.h
+**
+** Hardware abstraction layer. The game modules include this instead
+** of the avr-libc headers, so that they can be built for the AVR
+** (the default) or for a Linux host (when HAL_HOST is defined) - e.g.
+** to test and profile the game logic off the board.
+**
+** It gives access to the ports, UART, tick source, EEPROM and program
+** memory. For the AVR (hal_avr.h, hal_avr.c) the operations which run
+** in interrupt handlers or once per row of the display are macros or
+** inline functions which access the registers directly, so using
+** the HAL costs nothing. For the host (hal_host.h, hal_host.c) they
+** are functions which simulate the hardware.
+*/
+
+/* Guard band to ensure this definition is only included once */
+#ifndef HAL_H
+#define HAL_H
+
+#include <inttypes.h>
+
+/* The counts of the tick timer in a tick, and in the last part of it
+** given to hal_display_row_later() - a third, to the nearest count
+*/
+#define HAL_TICK_COUNTS 125
+#define HAL_DISPLAY_LATER_COUNTS 42
+
+#ifdef HAL_HOST
+#include "hal_host.h"
+#else
+#include "hal_avr.h"
+#endif
+
+/*
+** Each backend also provides:
+**
+** Program memory - PROGMEM, PSTR(), pgm_read_byte(), pgm_read_word(),
+** and pgm_read_ptr() as in avr-libc.
+** _crc16_update() as in avr-libc's util/crc16.h.
+**
+** EEPROM - EEMEM, eeprom_read_byte(), eeprom_read_word() and
+** eeprom_read_block() as in avr-libc. HAL_EEPROM_ADDRESS(p) gives the
+** EEPROM address of an EEMEM variable.
+** hal_eeprom_read(address) reads a byte. hal_eeprom_write(address,
+** data) starts writing a byte, and hal_eeprom_busy() is true until
+** it is written. hal_eeprom_ready_interrupt(1) makes
+** eeprom_queue_ready() be called (with interrupts off) whenever the
+** EEPROM is ready for another write, until
+** hal_eeprom_ready_interrupt(0).
+**
+** Interrupts - hal_interrupts_on() turns interrupts on.
+** hal_interrupts_off() turns them off and returns whether they were on,
+** to be passed to hal_interrupts_restore().
+**
+** LED matrix - hal_display_row(row, portB, portA) selects the given
+** row and outputs the (inverted) column data for it.
+** hal_display_row_later(portB, portA) makes the column data change to
+** the given data for the last HAL_DISPLAY_LATER_COUNTS of the
+** HAL_TICK_COUNTS counts of the current tick (for brightness levels -
+** see led_display.h). It must be called from the tick interrupt, soon
+** after the tick (within the first half of it).
+** hal_profile_pin(high) sets the profiling output (see led_display.h).
+**
+** UART - hal_uart_put(c) sends a byte. hal_uart_tx_empty() is true
+** if another byte can be sent. hal_uart_tx_interrupt(1) makes
+** serial_tx_ready() be called (with interrupts off) whenever another
+** byte can be sent, until hal_uart_tx_interrupt(0).
+** serial_received() is called (with interrupts off) with each byte
+** received.
+**
+** Noise - hal_timer_count() reads the count of the tick timer, which
+** changes every 16us. Read when a key is pressed it is as random as the
+** player's timing, which is all there is to seed random numbers from
+** (the AT90S8515 has no ADC to take noise from).
+**
+** Sound - hal_tone(ocr) starts a square wave with half period ocr+1
+** (in 4MHz clock cycles), hal_tone_off() stops it.
+*/
+
+/* Set up the LED matrix outputs */
+void hal_display_init(void);
+
+/* Set up the UART (8 data bits, no parity) */
+void hal_uart_init(long baudrate);
+
+/* Start the tick - display_row() and then timer_tick() will be called
+** every 2ms (with interrupts off)
+*/
+void hal_tick_init(void);
+
+/* Set up the sound output (initially off) */
+void hal_sound_init(void);
+
+/* Returns the number of bytes of RAM between the static data and the
+** stack that the stack has never reached since reset - the AVR fills
+** them with a pattern before the stack is set up, and this counts the
+** bytes that still hold it (so it can be a few bytes high, if the
+** stack happened to leave the same value). The host returns 0.
+*/
+uint16_t hal_stack_unused(void);
+
+/* The handlers the HAL calls, which are defined by the drivers */
+void display_row(void);
+void timer_tick(void);
+void serial_tx_ready(void);
+void serial_received(char c);
+void eeprom_queue_ready(void);
+
+#endif
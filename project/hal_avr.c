@@ -0,0 +1,182 @@
+/*
+** hal_avr.c
+**
+** AT90S8515 backend of the hardware abstraction layer - the hardware
+** set up and the interrupt handlers, which pass the interrupts on to
+** the drivers. See hal.h.
+*/
+
+#include "hal.h"
+
+/* Clock rate in Hz. (The L at the end makes this a long constant (32 bit)
+** as opposed to an integer constant (16 bit).) */
+#define SYSCLK 4000000L
+
+/* The RAM from the end of the static data to the top of RAM (where
+** the stack starts) is filled with this at reset - see
+** hal_stack_unused()
+*/
+#define STACK_PAINT 0xC5
+
+/* From the linker */
+extern uint8_t _end;
+extern uint8_t __stack;
+
+volatile uint8_t halEepromReady;
+volatile uint8_t halDisplayLater;
+uint8_t halLaterPortB;
+uint8_t halLaterPortA;
+
+void hal_display_init(void) {
+	/* Set ports A and B to be outputs (except most significant
+	 * bit of port A) */
+	DDRA |= 0x7F;
+	DDRB |= 0xFF;
+
+	/* Set 3 least significant bits of C to be outputs */
+	DDRC |= 0x07;
+#ifdef PROFILE_DISPLAY
+	DDRC |= 0x80;
+#endif
+}
+
+void hal_uart_init(long baudrate) {
+	/* Configure the serial port baud rate */
+	/* (This differs from the datasheet formula so that we get
+	** rounding to the nearest integer while using integer division
+	** (which truncates)).
+	*/
+	UBRR = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
+
+	/*
+	** Enable transmission and receiving via UART, and the receive
+	** complete interrupt. We don't enable the UDR empty interrupt
+	** here (the driver does that when it has a character to
+	** transmit).
+	*/
+	UCR = (1<<RXEN)|(1<<TXEN)|(1<<RXCIE);
+}
+
+/* Set up AVR timer/counter 0 to give an interrupt
+** 500 times per second (once every 2 milliseconds). We will divide
+** the system clock by 64 so that timer/counter 0 increments every
+** 16 micro-seconds (64/4000000 seconds). A count of 125 gives
+** 2 milliseconds.
+** Timer/counter 0 can only give an interrupt on overflow (255 -> 0)
+** so we set the initial counter value (TCNT0) to 256-125 = 131.
+** (Timer/counter 0 does not have any output comparison
+** functionality and it is only 8bits wide.) The first thing the
+** interrupt handler will do is reset the timer value to 131.
+*/
+void hal_tick_init(void) {
+	/* Make the timer count every 64 system clock cycles */
+	TCCR0 = (0<<CS02)|(1<<CS01)|(1<<CS00);
+	/* Set the initial value of the timer/counter */
+	TCNT0 = 131;
+
+	/* Enable timer/counter 0 overflow interrupt. Set bit TOIE0
+	 * of the TIMSK register.
+	 */
+	TIMSK |= (1<<TOIE0);
+
+	/* Clear the timer/counter 0 overflow flag by writing a 1
+	 * to the TOV0 bit of the TIFR register.
+	 */
+	TIFR = (1<<TOV0);
+}
+
+/* Timer1 toggles OC1A (port D bit 5) on a compare match and is
+** cleared by it (CTC mode). It is stopped until a tone is played.
+*/
+void hal_sound_init(void) {
+	DDRD = (1<<DDD5) | (1<<DDD4);
+	PORTD = 0;
+	TCCR1A = 0x40;
+	OCR1A = 1999;
+	TCCR1B = 0x08;
+}
+
+/*
+** Interrupt handler for timer 0 overflow. The CPU will clear the
+** overflow flag (TOV0) on calling this handler. An EEPROM byte takes
+** about 4ms to write, so checking whether the EEPROM is ready every
+** 2ms loses little of its speed.
+** If hal_display_row_later() was called during the last tick, this
+** interrupt has come HAL_DISPLAY_LATER_COUNTS early. We output the
+** later column data and set the timer to overflow at the end of the
+** tick.
+*/
+ISR(TIMER0_OVF_vect) {
+	if(halDisplayLater) {
+#ifdef PROFILE_DISPLAY
+		hal_profile_pin(1);
+#endif
+		TCNT0 = 256 - HAL_DISPLAY_LATER_COUNTS;
+		halDisplayLater = 0;
+		PORTB = halLaterPortB;
+		PORTA = halLaterPortA;
+#ifdef PROFILE_DISPLAY
+		hal_profile_pin(0);
+#endif
+		return;
+	}
+
+	/*
+	** Reset the timer so the next interrupt happens
+	** at an appropriate time (i.e. in 2ms)
+	*/
+	TCNT0 = 256 - HAL_TICK_COUNTS;
+
+	if(halEepromReady && bit_is_clear(EECR, EEWE)) {
+		eeprom_queue_ready();
+	}
+	display_row();
+	timer_tick();
+}
+
+/* UART Data Register Empty (i.e. another character can be written) */
+ISR(UART_UDRE_vect) {
+	serial_tx_ready();
+}
+
+/* UART Receive Complete.
+**
+** NOTE: We ignore the possibility of hardware input overrun, i.e. a new
+** character arriving before the old one is read from the UDR I/O register.
+*/
+ISR(UART_RX_vect) {
+	serial_received(UDR);
+}
+
+/* Fill the stack with STACK_PAINT. This runs from .init1, before the
+** zero register is cleared and the stack pointer is set up, so it is
+** written in assembly and uses no stack.
+*/
+void hal_paint_stack(void) __attribute__((naked, used, section(".init1")));
+
+void hal_paint_stack(void) {
+	__asm__ volatile(
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:
+		: "i" (STACK_PAINT));
+}
+
+uint16_t hal_stack_unused(void) {
+	const uint8_t* p = &_end;
+	uint16_t count = 0;
+
+	while(p <= &__stack && *p == STACK_PAINT) {
+		p++;
+		count++;
+	}
+	return count;
+}
@@ -0,0 +1,117 @@
+/*
+** hal_avr.h
+**
+** AT90S8515 backend of the hardware abstraction layer - see hal.h.
+** Don't include this directly - include hal.h.
+*/
+
+/* Guard band to ensure this definition is only included once */
+#ifndef HAL_AVR_H
+#define HAL_AVR_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+/* (Older versions of avr-libc don't have this) */
+#ifndef pgm_read_ptr
+#define pgm_read_ptr(address) ((void*)pgm_read_word(address))
+#endif
+
+#define HAL_EEPROM_ADDRESS(p) ((uint16_t)(p))
+
+/* The AT90S8515 has no EEPROM ready interrupt, so while
+** halEepromReady is set the tick interrupt calls eeprom_queue_ready()
+** whenever a write is not in progress (see hal_avr.c)
+*/
+extern volatile uint8_t halEepromReady;
+
+static inline uint8_t hal_interrupts_off(void) {
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	return interrupts_on;
+}
+
+static inline void hal_interrupts_restore(uint8_t interrupts_on) {
+	if(interrupts_on) {
+		sei();
+	}
+}
+
+#define hal_interrupts_on() sei()
+
+/* Row select is the 3 least significant bits of port C (the other
+** bits are left alone), columns 0 to 7 are port B and columns 8 to 14
+** are bits 0 to 6 of port A.
+*/
+static inline void hal_display_row(uint8_t row, uint8_t portB,
+		uint8_t portA) {
+	PORTC = (PORTC & 0xF8) | row;
+	PORTB = portB;
+	PORTA = portA;
+}
+
+/* The tick interrupt is brought forward by HAL_DISPLAY_LATER_COUNTS
+** counts, and when it happens with halDisplayLater set it only
+** outputs the later column data and times the rest of the tick (see
+** hal_avr.c)
+*/
+extern volatile uint8_t halDisplayLater;
+extern uint8_t halLaterPortB;
+extern uint8_t halLaterPortA;
+
+static inline void hal_display_row_later(uint8_t portB, uint8_t portA) {
+	halLaterPortB = portB;
+	halLaterPortA = portA;
+	halDisplayLater = 1;
+	TCNT0 += HAL_DISPLAY_LATER_COUNTS;
+}
+
+/* The profiling output is bit 7 of port C */
+#define hal_profile_pin(high) \
+	((high) ? (PORTC |= 0x80) : (PORTC &= ~0x80))
+
+/* Timer 0 counts from 131 to 255 every 2ms (but see
+** hal_display_row_later())
+*/
+#define hal_timer_count() TCNT0
+
+/* UCR is in the bottom of the I/O space so setting or clearing UDRIE
+** is a single (atomic) bit instruction
+*/
+#define hal_uart_put(c) (UDR = (c))
+#define hal_uart_tx_empty() bit_is_set(USR, UDRE)
+#define hal_uart_tx_interrupt(on) \
+	((on) ? (UCR |= (1 << UDRIE)) : (UCR &= ~(1 << UDRIE)))
+
+static inline uint8_t hal_eeprom_read(uint16_t address) {
+	EEAR = address;
+	EECR |= (1 << EERE);
+	return EEDR;
+}
+
+static inline void hal_eeprom_write(uint16_t address, uint8_t data) {
+	EEAR = address;
+	EEDR = data;
+	/* EEWE must be set within 4 cycles of EEMWE */
+	EECR |= (1 << EEMWE);
+	EECR |= (1 << EEWE);
+}
+
+#define hal_eeprom_busy() bit_is_set(EECR, EEWE)
+#define hal_eeprom_ready_interrupt(on) (halEepromReady = (on))
+
+/* Timer1 toggles OC1A each time it reaches OCR1A. Restart the count
+** so it can't be past the new OCR1A.
+*/
+static inline void hal_tone(uint16_t ocr) {
+	OCR1A = ocr;
+	TCNT1 = 0;
+	TCCR1B |= 0x01;
+}
+
+#define hal_tone_off() (TCCR1B &= 0xFE)
+
+#endif
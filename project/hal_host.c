@@ -0,0 +1,336 @@
+/*
+** hal_host.c
+**
+** Linux host backend of the hardware abstraction layer - see hal.h
+** and hal_host.h.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include "hal.h"
+
+#define LED_ROWS 7
+#define LED_COLUMNS 15
+
+/* The EEMEM variables - the linker gives the start and end of their
+** section
+*/
+extern uint8_t __start_hal_eeprom[] __attribute__((weak));
+extern uint8_t __stop_hal_eeprom[] __attribute__((weak));
+static FILE* eepromFile;
+
+/* The global interrupt flag, and the interrupts that are enabled or
+** waiting to be taken
+*/
+static uint8_t interruptsOn;
+static uint8_t tickEnabled;
+static uint8_t tickPending;
+static uint8_t uartTxEnabled;
+static uint8_t eepromReadyEnabled;
+static uint8_t rxPending;
+static char rxByte;
+
+static FILE* uartOutput;
+
+static uint32_t ledScans[LED_ROWS];
+static uint32_t ledLit[LED_ROWS][LED_COLUMNS];
+static uint8_t ledRow;		/* the row output last */
+static uint16_t ledColumns;	/* and the columns lit in it */
+
+static uint16_t toneOcr;
+
+static void take_interrupts(void);
+
+uint8_t hal_host_init(const char* eepromName, FILE* output) {
+	size_t size = __stop_hal_eeprom - __start_hal_eeprom;
+	FILE* file;
+
+	uartOutput = output;
+	interruptsOn = 0;
+	tickEnabled = 0;
+	tickPending = 0;
+	uartTxEnabled = 0;
+	eepromReadyEnabled = 0;
+	rxPending = 0;
+	toneOcr = 0;
+	hal_host_clear_leds();
+
+	if(size > HAL_EEPROM_SIZE) {
+		fprintf(stderr, "EEMEM variables use %u bytes (%u available)\n",
+				(unsigned)size, HAL_EEPROM_SIZE);
+		return 0;
+	}
+
+	/* Start erased, then load what was saved (if anything) */
+	memset(__start_hal_eeprom, 0xFF, size);
+	eepromFile = NULL;
+	if(eepromName) {
+		file = fopen(eepromName, "rb");
+		if(file) {
+			if(fread(__start_hal_eeprom, 1, size, file)) {
+				; /* A short file leaves the rest erased */
+			}
+			fclose(file);
+		}
+		eepromFile = fopen(eepromName, "wb");
+		if(!eepromFile) {
+			return 0;
+		}
+		fwrite(__start_hal_eeprom, 1, size, eepromFile);
+		fflush(eepromFile);
+	}
+	return 1;
+}
+
+/*
+** EEPROM
+*/
+
+uint16_t hal_eeprom_address(const void* p) {
+	return (const uint8_t*)p - __start_hal_eeprom;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* address) {
+	return *address;
+}
+
+uint16_t eeprom_read_word(const uint16_t* address) {
+	return *address;
+}
+
+void eeprom_read_block(void* destination, const void* source, size_t length) {
+	memcpy(destination, source, length);
+}
+
+uint8_t hal_eeprom_read(uint16_t address) {
+	return __start_hal_eeprom[address];
+}
+
+void hal_eeprom_write(uint16_t address, uint8_t data) {
+	__start_hal_eeprom[address] = data;
+	if(eepromFile) {
+		fseek(eepromFile, address, SEEK_SET);
+		fputc(data, eepromFile);
+		fflush(eepromFile);
+	}
+}
+
+uint8_t hal_eeprom_busy(void) {
+	return 0;
+}
+
+void hal_eeprom_ready_interrupt(uint8_t on) {
+	eepromReadyEnabled = on;
+	take_interrupts();
+}
+
+/*
+** Interrupts
+*/
+
+void hal_interrupts_on(void) {
+	interruptsOn = 1;
+	take_interrupts();
+}
+
+uint8_t hal_interrupts_off(void) {
+	uint8_t wasOn = interruptsOn;
+	interruptsOn = 0;
+	return wasOn;
+}
+
+void hal_interrupts_restore(uint8_t wasOn) {
+	if(wasOn) {
+		hal_interrupts_on();
+	}
+}
+
+/* Take the interrupts that are waiting (if interrupts are on), in the
+** AVR's priority order. Interrupts are off while each handler runs,
+** so this does nothing when called from inside a handler.
+*/
+static void take_interrupts(void) {
+	while(interruptsOn) {
+		interruptsOn = 0;
+		if(tickPending) {
+			tickPending = 0;
+			display_row();
+			timer_tick();
+		} else if(rxPending) {
+			rxPending = 0;
+			serial_received(rxByte);
+		} else if(uartTxEnabled) {
+			serial_tx_ready();
+		} else if(eepromReadyEnabled) {
+			eeprom_queue_ready();
+		} else {
+			interruptsOn = 1;
+			break;
+		}
+		interruptsOn = 1;
+	}
+}
+
+/*
+** Tick
+*/
+
+void hal_tick_init(void) {
+	tickEnabled = 1;
+}
+
+void hal_host_tick(void) {
+	if(tickEnabled) {
+		tickPending = 1;
+		take_interrupts();
+	}
+}
+
+uint8_t hal_timer_count(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint8_t)now.tv_nsec;
+}
+
+/*
+** LED matrix
+*/
+
+void hal_display_init(void) {
+	hal_host_clear_leds();
+}
+
+void hal_display_row(uint8_t row, uint8_t portB, uint8_t portA) {
+	uint16_t columns;
+	uint8_t column;
+
+	if(row >= LED_ROWS) {
+		return;
+	}
+	/* A 0 bit lights the LED */
+	columns = ~(portB | (uint16_t)portA << 8);
+	ledScans[row] += HAL_TICK_COUNTS;
+	for(column = 0; column < LED_COLUMNS; column++) {
+		if(columns & (1 << column)) {
+			ledLit[row][column] += HAL_TICK_COUNTS;
+		}
+	}
+	ledRow = row;
+	ledColumns = columns;
+}
+
+void hal_display_row_later(uint8_t portB, uint8_t portA) {
+	uint16_t columns;
+	uint8_t column;
+
+	/* The last part of the tick shows these columns instead */
+	columns = ~(portB | (uint16_t)portA << 8);
+	for(column = 0; column < LED_COLUMNS; column++) {
+		if(ledColumns & (1 << column)) {
+			ledLit[ledRow][column] -= HAL_DISPLAY_LATER_COUNTS;
+		}
+		if(columns & (1 << column)) {
+			ledLit[ledRow][column] += HAL_DISPLAY_LATER_COUNTS;
+		}
+	}
+	ledColumns = columns;
+}
+
+void hal_profile_pin(uint8_t high) {
+	(void)high;
+}
+
+uint8_t hal_host_led_level(uint8_t row, uint8_t column) {
+	if(ledScans[row] == 0) {
+		return 0;
+	}
+	return (uint8_t)(ledLit[row][column] * 255 / ledScans[row]);
+}
+
+void hal_host_clear_leds(void) {
+	memset(ledScans, 0, sizeof(ledScans));
+	memset(ledLit, 0, sizeof(ledLit));
+}
+
+void hal_host_print_leds(FILE* stream) {
+	uint8_t row;
+	uint8_t column;
+	uint8_t level;
+
+	for(row = 0; row < LED_ROWS; row++) {
+		for(column = 0; column < LED_COLUMNS; column++) {
+			level = hal_host_led_level(row, column);
+			fputc(level == 0 ? ' ' : level < 128 ? '.' :
+					level < 255 ? 'o' : '#', stream);
+		}
+		fputc('\n', stream);
+	}
+}
+
+/*
+** UART
+*/
+
+void hal_uart_init(long baudrate) {
+	(void)baudrate;
+}
+
+void hal_uart_put(char c) {
+	if(uartOutput) {
+		fputc(c, uartOutput);
+	}
+}
+
+uint8_t hal_uart_tx_empty(void) {
+	return 1;
+}
+
+void hal_uart_tx_interrupt(uint8_t on) {
+	uartTxEnabled = on;
+	take_interrupts();
+}
+
+void hal_host_uart_output(FILE* output) {
+	uartOutput = output;
+}
+
+void hal_host_receive(char c) {
+	rxByte = c;
+	rxPending = 1;
+	take_interrupts();
+}
+
+/*
+** Sound
+*/
+
+void hal_sound_init(void) {
+	toneOcr = 0;
+}
+
+void hal_tone(uint16_t ocr) {
+	toneOcr = ocr;
+}
+
+void hal_tone_off(void) {
+	toneOcr = 0;
+}
+
+uint16_t hal_host_tone(void) {
+	return toneOcr;
+}
+
+/*
+** Stack
+*/
+
+/* The host's stack isn't limited the way the AVR's is, so there is
+** nothing to measure
+*/
+uint16_t hal_stack_unused(void) {
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+** hal_host.h
+**
+** Linux host backend of the hardware abstraction layer - see hal.h.
+** Don't include this directly - include hal.h.
+**
+** The host simulates the parts of the board the game uses:
+** - Program memory is ordinary memory.
+** - The EEPROM is the EEMEM variables themselves (placed together in
+**   their own section), loaded from and written through to a file.
+**   Writes finish straight away.
+** - Interrupts are taken (one at a time, with interrupts off) as soon
+**   as they are enabled and interrupts are on, as on the AVR. The UART
+**   sends each byte straight away.
+** - Time only passes when hal_host_tick() is called (so wait_for()
+**   never returns).
+** - The LED matrix outputs are captured, so the host program can see
+**   what would be displayed.
+*/
+
+/* Guard band to ensure this definition is only included once */
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Program memory */
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_ptr(address) (*(void* const*)(address))
+
+/* EEPROM - the variables are packed with no padding between them, as
+** on the AVR, so that they take the same size
+*/
+#define EEMEM __attribute__((section("hal_eeprom"), aligned(1)))
+#define HAL_EEPROM_ADDRESS(p) hal_eeprom_address(p)
+#define HAL_EEPROM_SIZE 512
+uint16_t hal_eeprom_address(const void* p);
+uint8_t eeprom_read_byte(const uint8_t* address);
+uint16_t eeprom_read_word(const uint16_t* address);
+void eeprom_read_block(void* destination, const void* source, size_t length);
+uint8_t hal_eeprom_read(uint16_t address);
+void hal_eeprom_write(uint16_t address, uint8_t data);
+uint8_t hal_eeprom_busy(void);
+void hal_eeprom_ready_interrupt(uint8_t on);
+
+/* CRC-16 (polynomial 0xA001) - the same as avr-libc's */
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t data) {
+	uint8_t i;
+	crc ^= data;
+	for(i = 0; i < 8; i++) {
+		crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+	}
+	return crc;
+}
+
+/* Interrupts */
+void hal_interrupts_on(void);
+uint8_t hal_interrupts_off(void);
+void hal_interrupts_restore(uint8_t interrupts_on);
+
+/* LED matrix */
+void hal_display_row(uint8_t row, uint8_t portB, uint8_t portA);
+void hal_display_row_later(uint8_t portB, uint8_t portA);
+void hal_profile_pin(uint8_t high);
+
+/* Noise (the nanoseconds of the host's clock) */
+uint8_t hal_timer_count(void);
+
+/* UART */
+void hal_uart_put(char c);
+uint8_t hal_uart_tx_empty(void);
+void hal_uart_tx_interrupt(uint8_t on);
+
+/* Sound */
+void hal_tone(uint16_t ocr);
+void hal_tone_off(void);
+
+/*
+** Host only functions
+*/
+
+/* Set up the simulated board. The EEPROM is loaded from the given file
+** (if it exists - otherwise it starts erased) and every byte written
+** to the EEPROM is written to the file. If the file name is NULL the
+** EEPROM is not saved. UART output goes to the given stream (which
+** may be NULL to throw it away). Returns 0 if the file could not be
+** opened.
+*/
+uint8_t hal_host_init(const char* eepromFile, FILE* uartOutput);
+
+/* Let 2ms pass - the tick interrupt happens if it is enabled */
+void hal_host_tick(void);
+
+/* Receive a byte on the UART */
+void hal_host_receive(char c);
+
+/* Send the UART output to the given stream from now on (NULL throws it
+** away)
+*/
+void hal_host_uart_output(FILE* output);
+
+/* The captured LED matrix. Each time a row is output, each column in it
+** that is lit has its count increased by the timer counts it is lit
+** for (taking hal_display_row_later() into account - the tick itself
+** isn't split). hal_host_led_level() gives the fraction of the time
+** the row was output that the LED was lit, scaled to 0 - 255. hal_host_clear_leds() clears the counts.
+** hal_host_print_leds() prints the matrix - each LED is shown as
+** ' ' (off), '.', 'o' or '#' (fully on).
+*/
+uint8_t hal_host_led_level(uint8_t row, uint8_t column);
+void hal_host_clear_leds(void);
+void hal_host_print_leds(FILE* stream);
+
+/* The Timer1 compare value of the tone being played (0 if none) */
+uint16_t hal_host_tone(void);
+
+#endif
@@ -0,0 +1,104 @@
+/*
+** host_main.c
+**
+** Runs the game logic on a Linux host (see hal_host.h). The game is
+** run until the snake has moved once for each character of the first
+** argument (U, D, L or R to change direction first, anything else to
+** carry straight on) and the LED display, as captured from the display outputs, is printed
+** after each move. If a second argument is given it is the file that
+** holds the EEPROM, and the game is saved in slot 1 at the end. The
+** terminal mirror of the board (see board.h) is kept up to date as it
+** is on the board, and the bytes it sent are printed at the end.
+**
+** Usage: snake_host [moves] [eeprom file]
+*/
+
+#include <stdio.h>
+#include "hal.h"
+#include "board.h"
+#include "snake.h"
+#include "game.h"
+#include "score.h"
+#include "savestate.h"
+#include "led_display.h"
+#include "serialio.h"
+#include "timer.h"
+#include "eeprom_queue.h"
+
+/* Let the display show the frame once (every row, at every
+** brightness level), and print what it showed
+*/
+static void show_display(FILE* console) {
+	uint8_t i;
+
+	hal_host_clear_leds();
+	for(i = 0; i < NUM_ROWS; i++) {
+		hal_host_tick();
+	}
+	hal_host_print_leds(console);
+}
+
+int main(int argc, char* argv[]) {
+	const char* moves = argc > 1 ? argv[1] : "";
+	const char* eepromFile = argc > 2 ? argv[2] : NULL;
+	FILE* console = stdout;
+	GameState game;
+	RandomType rng;
+	int8_t input;
+	int8_t moveStatus = MOVE_OK;
+
+	/* The game's terminal output is thrown away */
+	if(!hal_host_init(eepromFile, NULL)) {
+		fprintf(stderr, "Can't use EEPROM file %s\n", eepromFile);
+		return 1;
+	}
+	init_timer();
+	init_eeprom_queue();
+	init_score();
+	init_save_slots();
+	init_serial_stdio(19200, 0);
+	hal_interrupts_on();
+
+	init_display();
+	game_configure(&game);
+	game_new(&game, &rng, 1);
+	set_board_mirror(1);
+	compose_board();
+	update_board_mirror();
+	show_display(console);
+
+	for(; *moves && moveStatus >= 0; moves++) {
+		switch(*moves) {
+			case 'U': case 'u': input = UP; break;
+			case 'D': case 'd': input = DOWN; break;
+			case 'L': case 'l': input = LEFT; break;
+			case 'R': case 'r': input = RIGHT; break;
+			default: input = GAME_NO_INPUT; break;
+		}
+		/* Step the game until the snake moves */
+		do {
+			moveStatus = game_step(&game, input, &rng);
+			input = GAME_NO_INPUT;
+			end_board_mirror_tick();
+		} while(moveStatus == 0);
+		compose_board();
+		update_board_mirror();
+		fprintf(console, "\n");
+		show_display(console);
+	}
+
+	fprintf(console, "%s - score %u\n", moveStatus < 0 ? "Game over" :
+			"Snake alive", get_score());
+	fprintf(console, "Terminal mirror: %u bytes in the last %u ticks\n",
+			board_mirror_bytes(), MIRROR_REPORT_TICKS);
+	if(eepromFile && moveStatus >= 0) {
+		if(save_state(0)) {
+			/* Queue the rest of the save as the queue empties */
+			do {
+				eeprom_queue_wait();
+			} while(save_step());
+			fprintf(console, "Saved in slot 1\n");
+		}
+	}
+	return 0;
+}
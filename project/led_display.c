@@ -8,20 +8,18 @@
 */
 
 #include "led_display.h"
-#include <avr/io.h>
+#include "hal.h"
 
-/* Global variable - see comment in header file */
-volatile uint16_t display[NUM_ROWS];
+/* The frame being shown (the front buffer). display_row() only
+ * reads it, and it is only changed with interrupts off, a whole frame
+ * at a time.
+ */
+DisplayFrameType displayFrame;
 
 void init_display(void) {
 
-	/* Set ports A and B to be outputs (except most significant
-	 * bit of port A) */
-	DDRA |= 0x7F;
-	DDRB |= 0xFF;
-
-	/* Set 3 least significant bits of C to be outputs */
-	DDRC |= 0x07;
+	/* Set up the ports we use as outputs */
+	hal_display_init();
 
 	/* Empty the display */
 	empty_display();
@@ -31,9 +29,39 @@ void init_display(void) {
 /* refactored init_display to make some code reusable */
 void empty_display(void){
 	uint8_t i;
-	for(i=0; i<NUM_ROWS; i++) {
-		display[i] = 0;
+	uint8_t plane;
+	uint8_t interrupts_on = hal_interrupts_off();
+	for(plane=0; plane<DISPLAY_PLANES; plane++) {
+		for(i=0; i<NUM_ROWS; i++) {
+			/* All LEDs off. (Bit 7 of port A is not used - we 
+			 * leave it at 1 as it always has been.)
+			 */
+			displayFrame[plane][i].portB = 0xFF;
+			displayFrame[plane][i].portA = 0xFF;
+		}
+	}
+	hal_interrupts_restore(interrupts_on);
+}
+
+void set_display_row(DisplayFrameType frame, uint8_t row, uint8_t plane,
+		uint16_t columns) {
+	/* A 0 bit lights the LED. Bit 7 of port A stays at 1. */
+	frame[plane][row].portB = ~(uint8_t)columns;
+	frame[plane][row].portA = ~(uint8_t)(columns >> 8) | 0x80;
+}
+
+void commit_display(const DisplayFrameType frame) {
+	const uint8_t* from = (const uint8_t*)frame;
+	uint8_t* to = (uint8_t*)displayFrame;
+	uint8_t i;
+	uint8_t interrupts_on;
+
+	/* Copy the whole frame between two rows */
+	interrupts_on = hal_interrupts_off();
+	for(i = 0; i < sizeof(DisplayFrameType); i++) {
+		to[i] = from[i];
 	}
+	hal_interrupts_restore(interrupts_on);
 }
 
 void display_row(void) {	
@@ -43,22 +71,28 @@ void display_row(void) {
 	 */
 	static uint8_t row = 0;
 
+#ifdef PROFILE_DISPLAY
+	hal_profile_pin(1);
+#endif
+
 	/* Increment our row number (and wrap around if necessary) */
 	if(++row == NUM_ROWS) {
 		row = 0;
 	}
 
-	/* Output our row number to port C. This assumes the other 
-	 * bits of port C are not being used. If they are, then
-	 * this line of code needs to be changed.
+	/* Output our row number and the row data (which is stored
+	 * ready to be written to ports B and A). With brightness levels
+	 * plane 1 is shown first, and plane 0 replaces it for the last
+	 * third of the row's time.
 	 */
-	PORTC = row;
+	hal_display_row(row, displayFrame[DISPLAY_PLANES - 1][row].portB,
+			displayFrame[DISPLAY_PLANES - 1][row].portA);
+#if DISPLAY_BAM
+	hal_display_row_later(displayFrame[0][row].portB, 
+			displayFrame[0][row].portA);
+#endif
 
-	/* Output the correct row data to ports A and B. (Port B gets
-	 * the high byte, port A gets the low byte.) We need to invert
-	 * the data since we need a low output for the LED to be lit. 
-	 * Note - most significant bit is not displayed/used.
-	 */
-	PORTB = ~(uint8_t)(display[row] & 0xFF);
-	PORTA = ~(uint8_t)((display[row] >> 8)& 0X7F);
+#ifdef PROFILE_DISPLAY
+	hal_profile_pin(0);
+#endif
 }
@@ -10,18 +10,70 @@
 #ifndef LED_DISPLAY_H
 #define LED_DISPLAY_H
 
-#include <avr/io.h>
+#include <inttypes.h>
 
 /* Number of rows in our display */
 #define NUM_ROWS 7
 
-/* Our display data - indexed by row number 0 to 6
- * (from top to bottom). Bit 14 (second most significant 
- * bit)is the rightmost column. Bit 0 (least significant 
- * bit) is the leftmost column. Bit 15 (most significant bit) 
- * is unused. A bit value of 1 indicates the LED is lit.
+/* How often (ms) display_row() is called - the HAL calls it on every
+ * tick (see hal.h). Each call shows one row, so the whole display is
+ * refreshed every NUM_ROWS * DISPLAY_SCAN_PERIOD ms.
  */
-extern volatile uint16_t display[NUM_ROWS];
+#define DISPLAY_SCAN_PERIOD 2
+
+/* Brightness levels (bit angle modulation). If DISPLAY_BAM is 1 each
+ * LED has a 2 bit brightness level - 0 (off) to 3 (fully on). The
+ * frame is stored as DISPLAY_PLANES bit planes, and both are shown
+ * within each row's DISPLAY_SCAN_PERIOD: plane 1 for the first two
+ * thirds and plane 0 for the last third (the tick timer interrupts
+ * once more to switch - see hal_display_row_later() in hal.h). So the
+ * LED is lit for level/3 of the time, and every level is refreshed
+ * with the whole display, every 14ms.
+ * If DISPLAY_BAM is 0 there is a single plane, and LEDs are on or off.
+ */
+#ifndef DISPLAY_BAM
+#define DISPLAY_BAM 1
+#endif
+
+#if DISPLAY_BAM
+#define DISPLAY_PLANES 2
+#else
+#define DISPLAY_PLANES 1
+#endif
+#define DISPLAY_MAX_LEVEL ((1 << DISPLAY_PLANES) - 1)
+
+/* If PROFILE_DISPLAY is defined, bit 7 of port C is high while 
+ * display_row() runs (and while the tick interrupt switches to plane
+ * 0), so the time spent in it can be seen on a scope (duty cycle =
+ * high time / DISPLAY_SCAN_PERIOD).
+ */
+
+/* Our display data. Rows are numbered 0 to 6 (from top to bottom) 
+ * and columns 0 to 14 (from left to right). Each row is stored as 
+ * the bytes to be written to port B (columns 0 to 7) and port A 
+ * (columns 8 to 14), already inverted (a 0 bit lights the LED), so
+ * display_row() just copies them out.
+ */
+typedef struct {
+	uint8_t portB;
+	uint8_t portA;
+} DisplayRowType;
+
+/* A whole frame - each row of each bit plane */
+typedef DisplayRowType DisplayFrameType[DISPLAY_PLANES][NUM_ROWS];
+
+/* Frames are drawn in a back buffer and then committed to be shown.
+ * The back buffer is the caller's (a local variable - a second static
+ * frame would take 28 more bytes of RAM, which the AT90S8515 doesn't
+ * have), and the display keeps scanning the frame shown last while it
+ * is drawn.
+ *
+ * set_display_row() sets one bit plane of one row of the back buffer
+ * (bit n of columns sets bit "plane" of the level of column n). Every
+ * row of every plane must be set before the frame is committed.
+ */
+void set_display_row(DisplayFrameType frame, uint8_t row, uint8_t plane,
+		uint16_t columns);
 
 void init_display(void);
 	/* Initialises the display, including setting data
@@ -40,7 +92,16 @@ void display_row(void);
 	 */
 
 //4209435
-/* turns off all LEDs */
+/* turns off all LEDs, all at once */
 void empty_display(void);
 
+void commit_display(const DisplayFrameType frame);
+	/* Show the given frame, all at once, from the next row
+	 * onwards. It is copied to the frame display_row() shows
+	 * with interrupts off - 28 bytes, so a tick interrupt is
+	 * held up by a few hundred cycles at most. The frame shown
+	 * never changes part way through (or between the planes
+	 * of) a row, so it never shows a partly drawn frame.
+	 */
+
 #endif
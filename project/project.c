@@ -14,14 +14,16 @@
 #include "terminalio.h"
 #include "timer.h"
 #include <stdio.h>
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <avr/pgmspace.h>
+#include "hal.h"
 //42094353
 #include "sound.h"
 #include "food.h"
 #include "wall.h"
 #include "savestate.h"
+#include "eeprom_queue.h"
+#include "game.h"
+#include "record.h"
+#include "events.h"
 
 #define SPLASHBOXSTARTY 6
 #define SPLASHBOXENDY	16
@@ -38,8 +40,6 @@
 #define PAUSE			2
 #define	GAMEOVER		-1
 #define PLAYING			1
-#define BLINKRATE		100
-#define RATSPEED		921
  
 
 /*
@@ -48,17 +48,27 @@
 void new_game(void);
 void splash_screen(void);
 void handle_game_over(void);
-void time_increment(void);
 //4209435
 void show_instruction(int8_t);
 void update_score(void);
 void pause_game(void);
+void show_save_slots(void);
 
-volatile uint8_t timePassedFlag = 0;
-int8_t mainTimerNum;
 //4209435
-int8_t foodTimerNum;
-int8_t ratsTimerNum;
+uint8_t saveSlot;	/* the save slot chosen for saving/loading */
+
+/* The game clock, the random number generator for the game, and the
+** input for the next tick of the game
+*/
+GameState game;
+RandomType gameRandom;
+int8_t gameInput = GAME_NO_INPUT;
+
+/* The recording of the game being played (written to EEPROM as it
+** is played, and sent over the serial port by pressing 'R' before a
+** game)
+*/
+RecordingType gameRecording;
 
 /*
  * main -- Main program.
@@ -69,22 +79,25 @@ int main(void) {
 
 	char c;
 
-	/* Initialise our main clock */
+	/* Initialise our main clock, and the events the game timers post */
 	init_timer();
+	init_events();
 
-	/* Initialise serial I/O */
-	init_serial_stdio(19200, 0);
+	/* Initialise the game periods */
+	game_configure(&game);
+	game.recording = &gameRecording;
 
-	/* Make the display_row() function be called every 2ms.
-	** (This function returns a timer number, but we ignore 
-	** this since we'll never do anything with it.)
-	*/
-	execute_function_periodically(2, display_row);
+	/* Initialise background EEPROM writes, and read back the high
+	** score (in case the first game is a loaded one) */
+	init_eeprom_queue();
+	init_score();
 
-	/* Register the time_increment() function to be called every 500ms.
-	** This function just sets a variable (timePassedFlag).
-	*/
-	mainTimerNum = execute_function_periodically(500, time_increment);
+	/* Read the save slot directory, and choose the newest save */
+	init_save_slots();
+	saveSlot = newest_save_slot();
+
+	/* Initialise serial I/O */
+	init_serial_stdio(19200, 0);
 
 	//4209435
 	/* setup AVR to handle sounds*/
@@ -93,7 +106,7 @@ int main(void) {
 	/*
 	** Turn on interrupts (needed for timer and serial input/output to work)
 	*/
-	sei();
+	hal_interrupts_on();
 	
 	/*
 	** Display splash screen 
@@ -107,18 +120,29 @@ int main(void) {
 	new_game();
 		
 	/*
-	** Event loop - wait for a certain amount of time to pass or wait
-	** for a character to arrive from standard input. The time_passed_flag
-	** is set within the function time_increment() below - which is setup
-	** to be called periodically.
+	** Event loop - run the game for each tick that has passed, or 
+	** wait for a character to arrive from standard input. The game
+	** timer posts an event for each tick (see events.h).
 	*/
 	for(;;) {
-		if(timePassedFlag) {
-			moveStatus = move_snake();
-			timePassedFlag = 0;
-		} else if(input_available()) {
+		/* Step the game (until it is over) */
+		while(moveStatus >= 0 && get_event() == EVENT_GAME_TICK) {
+			moveStatus = game_step(&game, gameInput, &gameRandom);
+			gameInput = GAME_NO_INPUT;
+			end_board_mirror_tick();
+			switch(moveStatus){
+				case ATE_FOOD:
+					play_melody(MELODY_EAT);
+					break;
+				case ATE_RAT:
+					play_melody(MELODY_RAT);
+					break;
+			}
+		}
+
+		if(input_available()) {
 			/* Read the input from our terminal and handle it */
-			c = fgetc(stdin);			
+			c = serial_get_char();			
 			if(chars_into_escape_sequence == 0 && c == '\x1b') {
 				/*
 				** Received ESCAPE character - we're one character into
@@ -137,22 +161,22 @@ int main(void) {
 				if (c == 'C') {
 					/* Cursor right key pressed - Set next direction to
 					** be moved to RIGHT */
-					set_snake_dirn(RIGHT);
+					gameInput = RIGHT;
 				}  
 				if (c == 'D') {
 					/* Cursor left key pressed - Set next direction to
 					** be moved to LEFT */
-					set_snake_dirn(LEFT);
+					gameInput = LEFT;
 				}  
 				if (c == 'A') {
 					/* Cursor up key pressed - Set next direction to
 					** be moved to UP */
-					set_snake_dirn(UP);
+					gameInput = UP;
 				}  
 				if (c == 'B') {
 					/* Cursor down key pressed - Set next direction to
 					** be moved to DOWN */
-					set_snake_dirn(DOWN);
+					gameInput = DOWN;
 				}
 
 				/* else, unknown escape sequence */
@@ -167,8 +191,9 @@ int main(void) {
 				*/
 				chars_into_escape_sequence = 0;
 			} else if (c == ' ') {
-				/* Space character received - move snake immediately */
-				moveStatus = move_snake();
+				/* Space character received - move snake on the
+				** next tick */
+				gameInput = GAME_MOVE_NOW;
 			} else {					
 				if(c == 'N' || c == 'n'){	
 					show_instruction(NEWGAME);				
@@ -179,17 +204,23 @@ int main(void) {
 				} else if(c == 'M' || c == 'm'){
 					toggle_sound();
 					display_sound_status();
+				} else if(c == 'T' || c == 't'){
+					/* Toggle the terminal mirror of the board */
+					set_board_mirror(!board_mirror_on());
 				}
 			}
 		}
 
-		switch(moveStatus){
-			case ATE_FOOD:
-				if(sound_status())
-					play_sound();
-				moveStatus = MOVE_OK;
-				break;
-		}
+		/* Compose the LED board from the board layers and show 
+		** everything that changed this time around the loop at once
+		*/
+		compose_board();
+
+		/* Redraw the score and the changed parts of the board
+		** mirror (without waiting)
+		*/
+		refresh_score();
+		update_board_mirror();
 
 		if(moveStatus < 0) {
 			/* Move failed - game over */
@@ -200,46 +231,77 @@ int main(void) {
 	}
 }
 
-void time_increment(void) {
-	/* Function that gets called when a certain amount of time passes */
-	timePassedFlag = 1;
-}
-
 void new_game(void) {
 	char c = 0;
-	cancel_software_timer(foodTimerNum);
-	cancel_software_timer(ratsTimerNum);
+	uint32_t seed;
+	/* Keep the high score and the recording of the game that has 
+	** just finished (or been abandoned) */
+	commit_highscore();
+	record_end(&gameRecording, game.tick);
+	stop_game_timers();
 	empty_display();
 
 	//wait for space
 	while(c != ' ' && c != 'l' && c != 'L'){
 		if(input_available())
-			c = fgetc(stdin);
+			c = serial_get_char();
 
 		if(c == 'M' || c == 'm'){
 			toggle_sound();
 			display_sound_status();
 			c = 0;
 		}
+
+		if(c >= '1' && c < '1' + SAVE_SLOTS){
+			saveSlot = c - '1';
+			show_save_slots();
+			c = 0;
+		}
+
+		if(c == 'K' || c == 'k'){
+			/* How close the stack has come to the static data since
+			** reset (see STACK_RESERVE in the Makefile) */
+			move_cursor(1, INSTRUCTY + 5);
+			clear_to_end_of_line();
+			serial_puts_P(PSTR("Stack never used: "));
+			print_unsigned(hal_stack_unused());
+			c = 0;
+		}
+
+		if(c == 'R' || c == 'r'){
+			/* Send the last recording (which may be from before a 
+			** reset) to be replayed on a PC */
+			move_cursor(1, INSTRUCTY + 5);
+			if(!dump_recording())
+				serial_puts_P(PSTR("No recording."));
+			c = 0;
+		}
 	}
 	
+	/* Each game has a new seed - the state the last game left the
+	** food stream in, with the exact time of the key press that
+	** started it mixed in. (time may be read as it changes - that
+	** only adds to the noise.) */
+	seed = random_mix(gameRandom.food, ((uint32_t)time << 8) | hal_timer_count());
+
 	init_display();
 	
 	if(c == 'l' || c == 'L'){
-		if(load_state())
+		if(load_state(saveSlot)) {
 			render_board();
+			game_init(&game);
+		}
 		else {
 			/* Initialise internal representations. */
-			init_board();
-			init_score();
+			game_new(&game, &gameRandom, seed);
 		}
 	}
 	else {
 		/* Initialise internal representations. */
-		init_board();
-		init_score();
+		game_new(&game, &gameRandom, seed);
 	}
 	clear_terminal();
+	redraw_board_mirror();
 
 	//Place scores
 	update_score();
@@ -248,12 +310,7 @@ void new_game(void) {
 	display_sound_status();
 
 	show_instruction(PLAYING);
-
-	/* Make food blink 5 times a second. We should call blink_food
-	** 10 times a second which is 100ms
-	*/
-	foodTimerNum = execute_function_periodically(BLINKRATE, blink_food);
-	ratsTimerNum = execute_function_periodically(RATSPEED, move_rats);
+	start_game_timers();
 
 	/* Debug *
 	move_cursor(0, TITLEY-1);
@@ -278,7 +335,7 @@ void splash_screen(void) {
 	display_sound_status();
 
 	move_cursor(0,TITLEY);
-	printf_P(PSTR("Snake\n\nBy: Justin Mancinelli\n\nID: 42094353"));
+	serial_puts_P(PSTR("Snake\n\nBy: Justin Mancinelli\n\nID: 42094353"));
 	//move_cursor(NAMEX,NAMEY);
 	//printf_P(PSTR(""));
 	//move_cursor(IDX,IDY);
@@ -287,6 +344,8 @@ void splash_screen(void) {
 }
 
 void show_instruction(int8_t status){
+	move_cursor(1, INSTRUCTY + 3);
+	clear_to_end_of_line();
 	move_cursor(1, INSTRUCTY + 1);
 	clear_to_end_of_line();
 	move_cursor(1, INSTRUCTY);
@@ -294,30 +353,54 @@ void show_instruction(int8_t status){
 	
 	switch(status){
 		case NEWGAME:	
-			printf_P(PSTR("Welcome! Press 'space' to start a new game.\nPress 'L' to to load a saved game."));
+			serial_puts_P(PSTR("Welcome! Press 'space' to start a new game.\nPress 'L' to to load a saved game, 'R' to send the last recording."));
 			//printf_P(PSTR("Press 'L' to to load a saved game."));
+			show_save_slots();
 			break;
 		case GAMEOVER:
-			printf_P(PSTR("Game Over! Press 'space' to start a new game.\nPress 'L' to to load a saved game."));
+			serial_puts_P(PSTR("Game Over! Press 'space' to start a new game.\nPress 'L' to to load a saved game, 'R' to send the last recording."));
 			//printf_P(PSTR("Press 'L' to to load a saved game."));
+			show_save_slots();
 			break;
 		case PAUSE:
-			printf_P(PSTR("Paused... Press 'P' to continue.\nPress 'S' to save game state."));
+			serial_puts_P(PSTR("Paused... Press 'P' to continue.\nPress 'S' to save game state."));
 			//printf_P(PSTR("Press 'S' to save game state."));
+			show_save_slots();
 			break;
 		case PLAYING:
 			move_cursor(1, TITLEY);
 			clear_to_end_of_line();
 			move_cursor(1, INSTRUCTY);
-			printf_P(PSTR("Have fun! Press 'N' to start a new game.\nPress 'P' to to pause the game."));
+			serial_puts_P(PSTR("Have fun! Press 'N' to start a new game.\nPress 'P' to to pause the game."));
 			//printf_P(PSTR("Press 'P' to to pause the game."));
 			break;
 	}			
 }
 
+/* List the save slots (from the directory read at start up) and
+** their scores, marking the chosen one. Only reads RAM.
+*/
+void show_save_slots(void){
+	uint8_t slot;
+
+	move_cursor(1, INSTRUCTY + 3);
+	clear_to_end_of_line();
+	serial_puts_P(PSTR("Save slots (press a number to choose):"));
+	for(slot = 0; slot < SAVE_SLOTS; slot++){
+		serial_put_char(' ');
+		serial_put_char(slot == saveSlot ? '>' : ' ');
+		serial_put_char('1' + slot);
+		serial_put_char(':');
+		if(save_slot_used(slot))
+			print_unsigned(save_slot_score(slot));
+		else
+			serial_put_char('-');
+	}
+}
+
 void handle_game_over(void) {
-	cancel_software_timer(foodTimerNum);
-	cancel_software_timer(ratsTimerNum);
+	stop_game_timers();
+	play_melody(MELODY_GAME_OVER);
 	splash_screen();	
 	show_instruction(GAMEOVER);
 	new_game();
@@ -330,36 +413,62 @@ void pause_game() {
 	*/
 	static uint8_t status = 0;
 	char c = 0;
+	uint8_t saving = 0;
+	uint8_t queueing = 0;
 
 	if(status) {
 		move_cursor(28, TITLEY);
 		clear_to_end_of_line();
 		show_instruction(PLAYING);
-		render_board();
-		foodTimerNum = execute_function_periodically(BLINKRATE, blink_food);
-		ratsTimerNum = execute_function_periodically(RATSPEED, move_rats);
+		redraw_board();
+		/* The game clock carries on from where it stopped */
+		start_game_timers();
 		status = 0;
 	}
 	else {
 		show_instruction(PAUSE);
-		cancel_software_timer(foodTimerNum);
-		cancel_software_timer(ratsTimerNum);
+		stop_game_timers();
 		empty_display();
 		status = 1;
 
-		while(c != 'p' && c != 'P'){
-			if(input_available())
-				c = fgetc(stdin);
+		/* The game carries on once 'P' is pressed and all of any save
+		** is queued
+		*/
+		while((c != 'p' && c != 'P') || queueing){
+			if(input_available() && c != 'p' && c != 'P')
+				c = serial_get_char();
 
 			if(c == 's' || c == 'S'){
-				save_state();
 				//move_cursor(0, TITLEY);
 				//clear_to_end_of_line();
 				move_cursor(28, TITLEY);
-				printf_P(PSTR("State has been saved."));
+				if(save_state(saveSlot)) {
+					serial_puts_P(PSTR("Saving state...      "));
+					show_save_slots();
+					saving = 1;
+				} else {
+					serial_puts_P(PSTR("Still saving.        "));
+				}
 				c = 0;
 			}
 
+			if(c >= '1' && c < '1' + SAVE_SLOTS){
+				saveSlot = c - '1';
+				show_save_slots();
+				c = 0;
+			}
+
+			/* The save is queued a part at a time, as the EEPROM queue
+			** has room, and written in the background - so this loop
+			** never waits for the EEPROM
+			*/
+			queueing = save_step();
+			if(saving && !queueing && eeprom_queue_idle()) {
+				move_cursor(28, TITLEY);
+				serial_puts_P(PSTR("State has been saved."));
+				saving = 0;
+			}
+
 		}
 		pause_game();
 
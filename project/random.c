@@ -0,0 +1,59 @@
+/*
+** random.c
+**
+** Random number streams - see random.h.
+*/
+
+#include "random.h"
+
+/* Used to seed each stream differently (any odd constants will do) */
+#define FOOD_STREAM 0x9E3779B9UL
+#define RATS_STREAM 0x7F4A7C15UL
+
+/* The finalizer of MurmurHash3 - every bit of the result depends on
+** every bit of h. It is only used when seeding, so the multiplies
+** don't matter.
+*/
+static uint32_t mix32(uint32_t h) {
+	h ^= h >> 16;
+	h *= 0x85EBCA6BUL;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35UL;
+	h ^= h >> 16;
+	return h;
+}
+
+/* Seed one stream. xorshift never leaves 0, so that is avoided. */
+static void seed_stream(RandomStream* stream, uint32_t seed) {
+	*stream = mix32(seed);
+	if(*stream == 0) {
+		*stream = FOOD_STREAM;
+	}
+}
+
+void random_seed(RandomType* rng, uint32_t seed) {
+	seed_stream(&rng->food, seed ^ FOOD_STREAM);
+	seed_stream(&rng->rats, seed ^ RATS_STREAM);
+}
+
+/* Marsaglia's xorshift32 (shifts 13, 17, 5) - period 2^32 - 1 */
+uint32_t random_next(RandomStream* stream) {
+	uint32_t x = *stream;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*stream = x;
+	return x;
+}
+
+uint8_t random_below(RandomStream* stream, uint8_t n) {
+	/* A 16 by 8 bit multiply - the compiler can widen it without
+	** doing a full 32 bit one
+	*/
+	return ((uint32_t)(uint16_t)(random_next(stream) >> 16) * n) >> 16;
+}
+
+uint32_t random_mix(uint32_t seed, uint32_t noise) {
+	return mix32(seed + FOOD_STREAM) ^ noise;
+}
@@ -0,0 +1,56 @@
+/*
+** random.h
+**
+** Random numbers for the game. Each part of the game that needs them
+** has its own stream - an xorshift generator with 32 bits of state -
+** so that e.g. how the rats move doesn't change where food is placed.
+** The streams are all seeded from one 32 bit seed, which is all a
+** recording of the game needs to keep (see record.h).
+**
+** There is no division anywhere: a number below n is the top 16 bits
+** of the next number scaled by n (multiply-shift). The rand2() it
+** replaces did a 16 bit multiply and two 16 bit modulos. The
+** AT90S8515 has neither a multiply nor a divide instruction, so each
+** of those is a library call - this saves the two divisions, at the
+** cost of 32 bit shifts in the xorshift step. (This has not been
+** timed on the AVR - random_host.c times both on the host.)
+*/
+
+/* Guard band to ensure this definition is only included once */
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <inttypes.h>
+
+typedef uint32_t RandomStream;
+
+/* The state of the random number generators. The game owns it and
+** passes it to the functions that need it, so there is no hidden
+** state and a game can be replayed from its seed.
+*/
+typedef struct {
+	RandomStream food;	/* placing food */
+	RandomStream rats;	/* choosing which way rats go */
+} RandomType;
+
+/* Seed all the streams */
+void random_seed(RandomType* rng, uint32_t seed);
+
+/* Returns the next number from the stream (never 0) */
+uint32_t random_next(RandomStream* stream);
+
+/* Returns a number from 0 to n-1 (n must be at least 1). Each number is
+** returned for either floor(65536/n) or ceil(65536/n) of the 65536
+** possible top halves of random_next(), so the bias is less than
+** n/65536 (under 0.4%) - none at all if n is a power of 2. The game
+** only needs small ranges (at most the 105 cells of the board), so n
+** is 8 bits to keep the multiply short.
+*/
+uint8_t random_below(RandomStream* stream, uint8_t n);
+
+/* Returns the seed with the given noise (e.g. a timer count) mixed
+** into it
+*/
+uint32_t random_mix(uint32_t seed, uint32_t noise);
+
+#endif
@@ -0,0 +1,166 @@
+/*
+** random_host.c
+**
+** Checks and times the random number streams (see random.h) on a Linux
+** host. For each range the game draws from, the exact bias of
+** random_below() is worked out over all 65536 inputs, and a sample is
+** drawn and checked with a chi-squared test. The draws are then timed
+** against rand2(), the generator they replaced.
+**
+** Usage: snake_random [draws] [seed]
+** Exits with 1 if a range fails the test.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "random.h"
+
+/* The ranges checked - the directions, the number of free cells from
+** a nearly full board to an empty one, and some awkward ones
+*/
+static const uint8_t ranges[] = {
+	1, 2, 3, 4, 5, 7, 10, 50, 99, 100, 101, 105, 128, 200, 255
+};
+#define NUM_RANGES (sizeof(ranges) / sizeof(ranges[0]))
+
+/* A sample fails if its chi-squared statistic is this many standard
+** deviations above the mean
+*/
+#define FAIL_SIGMAS 5.0
+
+/* The generator random.h replaced
+** (http://www.daniweb.com/code/snippet216329.html by "vegaseat").
+** On the AVR an int is 16 bits, so a uint16_t is promoted to an
+** unsigned int and all of this was unsigned 16 bit arithmetic - the
+** cast does the same here.
+*/
+static uint16_t rand2(uint16_t* rng, uint16_t lim) {
+	*rng = (uint16_t)(*rng * 32719u + 3) % 32749;
+	return ((*rng % lim) + 1);
+}
+
+static double elapsed_ns(const struct timespec* start,
+		const struct timespec* end) {
+	return (end->tv_sec - start->tv_sec) * 1e9 +
+			(end->tv_nsec - start->tv_nsec);
+}
+
+/* The largest relative difference from a fair share of the 65536
+** inputs that any result of random_below(n) gets
+*/
+static double exact_bias(uint8_t n) {
+	uint32_t counts[256];
+	double fair = 65536.0 / n;
+	double bias = 0;
+	uint32_t x;
+	uint32_t i;
+
+	for(i = 0; i < n; i++) {
+		counts[i] = 0;
+	}
+	for(x = 0; x < 65536; x++) {
+		counts[(x * n) >> 16]++;
+	}
+	for(i = 0; i < n; i++) {
+		if(fabs(counts[i] - fair) / fair > bias) {
+			bias = fabs(counts[i] - fair) / fair;
+		}
+	}
+	return bias;
+}
+
+/* Draw from the stream and return how many standard deviations the
+** chi-squared statistic is from its mean (for n - 1 degrees of freedom)
+*/
+static double sample_sigmas(RandomStream* stream, uint8_t n,
+		uint32_t draws) {
+	uint32_t counts[256];
+	double expected = (double)draws / n;
+	double chi2 = 0;
+	uint32_t i;
+
+	if(n == 1) {
+		return 0;
+	}
+	for(i = 0; i < n; i++) {
+		counts[i] = 0;
+	}
+	for(i = 0; i < draws; i++) {
+		counts[random_below(stream, n)]++;
+	}
+	for(i = 0; i < n; i++) {
+		chi2 += (counts[i] - expected) * (counts[i] - expected) / expected;
+	}
+	return (chi2 - (n - 1)) / sqrt(2.0 * (n - 1));
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t draws = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000000;
+	uint32_t seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+	RandomType rng;
+	uint16_t oldRng = 1;
+	volatile uint32_t sink = 0;
+	uint32_t sum;
+	uint32_t i;
+	uint8_t r;
+	uint8_t failed = 0;
+	double sigmas;
+	struct timespec start;
+	struct timespec end;
+
+	if(draws == 0) {
+		fprintf(stderr, "Usage: snake_random [draws] [seed]\n");
+		return 1;
+	}
+
+	/* Bias */
+	random_seed(&rng, seed);
+	printf("%6s %12s %10s\n", "range", "exact bias", "chi2 sigma");
+	for(r = 0; r < NUM_RANGES; r++) {
+		sigmas = sample_sigmas(&rng.food, ranges[r], draws);
+		printf("%6u %12.6f %10.2f%s\n", ranges[r], exact_bias(ranges[r]),
+				sigmas, sigmas > FAIL_SIGMAS ? "  FAILED" : "");
+		if(sigmas > FAIL_SIGMAS) {
+			failed = 1;
+		}
+	}
+
+	/* The food and rat streams must not follow each other */
+	sum = 0;
+	random_seed(&rng, seed);
+	for(i = 0; i < draws; i++) {
+		sum += random_below(&rng.food, 4) == random_below(&rng.rats, 4);
+	}
+	sigmas = (sum - draws / 4.0) / sqrt(draws * 3.0 / 16);
+	printf("Food and rat streams agree %.4f of the time (%.2f sigma)%s\n",
+			(double)sum / draws, sigmas,
+			fabs(sigmas) > FAIL_SIGMAS ? "  FAILED" : "");
+	if(fabs(sigmas) > FAIL_SIGMAS) {
+		failed = 1;
+	}
+
+	/* Speed - summed so that the draws aren't optimised away */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sum = 0;
+	for(i = 0; i < draws; i++) {
+		sum += random_below(&rng.rats, 105);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	sink += sum;
+	printf("random_below(105) %.2f ns/draw\n",
+			elapsed_ns(&start, &end) / draws);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sum = 0;
+	for(i = 0; i < draws; i++) {
+		sum += rand2(&oldRng, 105);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	sink += sum;
+	printf("rand2(105)        %.2f ns/draw\n",
+			elapsed_ns(&start, &end) / draws);
+
+	return failed;
+}
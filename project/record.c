@@ -0,0 +1,276 @@
+/*
+** record.c
+**
+** Recording and replaying games - see record.h.
+*/
+
+#include "record.h"
+#include "hal.h"
+#include "game.h"
+#include "board.h"
+#include "score.h"
+#include "eeprom_queue.h"
+#include "serialio.h"
+
+/* Room kept for the end event - the event byte, up to 5 bytes of
+** ticks, the score and the check
+*/
+#define RECORD_END_LENGTH 10
+
+/* EEPROM variables */
+uint8_t EEMEM ee_recording[RECORD_SIZE];
+
+static void write_image(uint8_t at, const uint8_t* data, uint8_t length);
+static uint8_t put_event(uint8_t* data, uint32_t ticks, uint8_t input);
+static uint8_t event_length(uint32_t ticks);
+
+void record_start(RecordingType* recording, uint32_t seed,
+		uint16_t movePeriod, uint16_t ratPeriod, uint16_t wallPeriod) {
+	uint8_t header[RECORD_HEADER_LENGTH];
+
+	/* Magic 0 - the recording isn't valid until it has ended */
+	header[0] = 0;
+	header[1] = RECORD_VERSION;
+	header[2] = 0;
+	header[3] = 0;
+	header[4] = (uint8_t)seed;
+	header[5] = (uint8_t)(seed >> 8);
+	header[6] = (uint8_t)(seed >> 16);
+	header[7] = (uint8_t)(seed >> 24);
+	header[8] = (uint8_t)movePeriod;
+	header[9] = (uint8_t)(movePeriod >> 8);
+	header[10] = (uint8_t)ratPeriod;
+	header[11] = (uint8_t)(ratPeriod >> 8);
+	header[12] = (uint8_t)wallPeriod;
+	header[13] = (uint8_t)(wallPeriod >> 8);
+	write_image(0, header, RECORD_HEADER_LENGTH);
+	recording->lastTick = 0;
+	recording->length = RECORD_HEADER_LENGTH;
+	recording->flags = 0;
+	recording->ended = 0;
+}
+
+void record_clear(RecordingType* recording) {
+	/* The image in EEPROM is left as it is - it is either a finished
+	** recording or still has magic 0
+	*/
+	recording->length = 0;
+}
+
+uint8_t record_used(const RecordingType* recording) {
+	return recording->length != 0;
+}
+
+void record_input(RecordingType* recording, uint32_t tick, int8_t input) {
+	uint8_t event[RECORD_END_LENGTH];
+	uint32_t ticks = tick - recording->lastTick;
+	uint8_t length;
+
+	if(!record_used(recording) || recording->ended ||
+			(recording->flags & RECORD_TRUNCATED)) {
+		return;
+	}
+	if(recording->length + event_length(ticks) > 
+			RECORD_SIZE - RECORD_END_LENGTH) {
+		/* Full - the replay will stop here */
+		recording->flags |= RECORD_TRUNCATED;
+		return;
+	}
+	length = put_event(event, ticks, input);
+	if(!eeprom_queue_write(&ee_recording[recording->length], event, 
+			length)) {
+		/* No room in the queue - stop here too */
+		recording->flags |= RECORD_TRUNCATED;
+		return;
+	}
+	recording->length += length;
+	recording->lastTick = tick;
+}
+
+void record_end(RecordingType* recording, uint32_t tick) {
+	uint8_t end[RECORD_END_LENGTH];
+	uint8_t header[4];
+	uint8_t length;
+	uint16_t check;
+
+	if(!record_used(recording) || recording->ended) {
+		return;
+	}
+	length = put_event(end, tick - recording->lastTick, RECORD_END);
+	end[length++] = (uint8_t)get_score();
+	end[length++] = (uint8_t)(get_score() >> 8);
+	check = record_check();
+	end[length++] = (uint8_t)check;
+	end[length++] = (uint8_t)(check >> 8);
+	write_image(recording->length, end, length);
+	recording->length += length;
+
+	/* Then make the recording valid */
+	header[0] = RECORD_MAGIC;
+	header[1] = RECORD_VERSION;
+	header[2] = recording->flags;
+	header[3] = recording->length;
+	write_image(0, header, sizeof(header));
+	recording->lastTick = tick;
+	recording->ended = 1;
+}
+
+uint16_t record_check(void) {
+	uint16_t crc = 0xFFFF;
+	const uint8_t* layers = (const uint8_t*)boardLayers;
+	uint8_t i;
+
+	/* The layers are only compared on the same machine, so the byte
+	** order doesn't matter
+	*/
+	for(i = 0; i < sizeof(boardLayers); i++) {
+		crc = _crc16_update(crc, layers[i]);
+	}
+	crc = _crc16_update(crc, (uint8_t)get_score());
+	crc = _crc16_update(crc, (uint8_t)(get_score() >> 8));
+	return crc;
+}
+
+/* Queue a write to the image in EEPROM at the given offset, waiting
+** for room if the queue is full. These writes must happen, or the
+** image in EEPROM would be inconsistent.
+*/
+static void write_image(uint8_t at, const uint8_t* data, uint8_t length) {
+	eeprom_queue_start(&ee_recording[at]);
+	while(length--) {
+		eeprom_queue_put(*data++);
+	}
+	eeprom_queue_finish();
+}
+
+/* Print a hex digit */
+static void put_digit(uint8_t digit) {
+	serial_put_char(digit < 10 ? '0' + digit : 'A' - 10 + digit);
+}
+
+uint8_t dump_recording(void) {
+	uint8_t header[4];
+	uint8_t data;
+	uint8_t i;
+
+	/* Make sure the recording has been written before reading it */
+	eeprom_queue_wait();
+	eeprom_read_block((void*)header, (const void*)ee_recording, 
+			sizeof(header));
+	if(header[0] != RECORD_MAGIC || header[1] != RECORD_VERSION ||
+			header[3] < RECORD_HEADER_LENGTH) {
+		return 0;
+	}
+	serial_puts_P(PSTR("REC "));
+	for(i = 0; i < header[3]; i++) {
+		data = eeprom_read_byte(&ee_recording[i]);
+		put_digit(data >> 4);
+		put_digit(data & 0x0F);
+	}
+	serial_put_char('\n');
+	return 1;
+}
+
+uint8_t replay_open(ReplayType* replay, const uint8_t* image,
+		uint16_t length) {
+	if(length < RECORD_HEADER_LENGTH || image[0] != RECORD_MAGIC ||
+			image[1] != RECORD_VERSION || image[3] > length ||
+			image[3] < RECORD_HEADER_LENGTH) {
+		return 0;
+	}
+	replay->flags = image[2];
+	replay->seed = image[4] | (uint32_t)image[5] << 8 |
+			(uint32_t)image[6] << 16 | (uint32_t)image[7] << 24;
+	replay->movePeriod = image[8] | (image[9] << 8);
+	replay->ratPeriod = image[10] | (image[11] << 8);
+	replay->wallPeriod = image[12] | (image[13] << 8);
+	replay->next = &image[RECORD_HEADER_LENGTH];
+	replay->end = &image[image[3]];
+	replay->tick = 0;
+	replay->input = GAME_NO_INPUT;
+	replay->endScore = 0;
+	replay->endCheck = 0;
+	return 1;
+}
+
+/* Read the next event into the replay (input RECORD_END if there are
+** none left)
+*/
+static void read_event(ReplayType* replay) {
+	const uint8_t* data = replay->next;
+	uint32_t ticks;
+	uint8_t shift;
+
+	if(data >= replay->end) {
+		replay->input = RECORD_END;
+		return;
+	}
+	replay->input = *data >> 5;
+	ticks = *data++ & 0x1F;
+	if(ticks == 0x1F) {
+		shift = 0;
+		while(data < replay->end) {
+			ticks += (uint32_t)(*data & 0x7F) << shift;
+			shift += 7;
+			if(!(*data++ & 0x80)) {
+				break;
+			}
+		}
+	}
+	replay->tick += ticks;
+	if(replay->input == RECORD_END && data + 4 <= replay->end) {
+		replay->endScore = data[0] | (data[1] << 8);
+		replay->endCheck = data[2] | (data[3] << 8);
+		data += 4;
+	}
+	replay->next = data;
+}
+
+int8_t replay_input(ReplayType* replay, uint32_t tick) {
+	int8_t input;
+
+	if(replay->input == GAME_NO_INPUT) {
+		read_event(replay);
+	}
+	if(replay->input == RECORD_END) {
+		return tick >= replay->tick ? RECORD_END : GAME_NO_INPUT;
+	}
+	if(tick != replay->tick) {
+		return GAME_NO_INPUT;
+	}
+	input = replay->input;
+	replay->input = GAME_NO_INPUT;
+	return input;
+}
+
+/* Write an event, returning its length */
+static uint8_t put_event(uint8_t* data, uint32_t ticks, uint8_t input) {
+	uint8_t length = 1;
+
+	if(ticks < 0x1F) {
+		*data = (input << 5) | ticks;
+		return 1;
+	}
+	*data++ = (input << 5) | 0x1F;
+	ticks -= 0x1F;
+	while(ticks >= 0x80) {
+		*data++ = (uint8_t)ticks | 0x80;
+		ticks >>= 7;
+		length++;
+	}
+	*data = (uint8_t)ticks;
+	return length + 1;
+}
+
+static uint8_t event_length(uint32_t ticks) {
+	uint8_t length = 1;
+
+	if(ticks >= 0x1F) {
+		ticks -= 0x1F;
+		do {
+			length++;
+			ticks >>= 7;
+		} while(ticks);
+	}
+	return length;
+}
@@ -0,0 +1,123 @@
+/*
+** record.h
+**
+** Recording of games, so that a game can be replayed exactly (e.g. on
+** the host - see replay_host.c). The game only depends on its random
+** number seed, its periods and the inputs given to game_step() on
+** each tick, so that is all that is recorded. game.c records the game
+** when GameState.recording points to a recording.
+**
+** A recording is an image of at most RECORD_SIZE bytes, which is
+** written straight to EEPROM (through the EEPROM queue) as the game is
+** played, and can be dumped over the serial port as it is:
+**	0		RECORD_MAGIC
+**	1		RECORD_VERSION
+**	2		flags (RECORD_TRUNCATED)
+**	3		length of the image
+**	4-7		random number seed
+**	8-13	move, rat and wall periods (ticks)
+**	14-		events
+** Numbers are little endian. Each event is a byte with the input in
+** the top 3 bits and the number of ticks since the last event in the
+** bottom 5 bits - or, if that doesn't fit, 31 followed by the rest
+** of the number (minus 31) 7 bits at a time, least significant first,
+** with the top bit set on all but the last byte. (Ticks are counted
+** as GameState.tick before the step the input is given to.) The last
+** event has the input RECORD_END, and is followed by the score and
+** record_check() at the end of the game.
+**
+** Only the running totals are kept in RAM. The header is written with
+** magic 0 when the game starts, so the last recording is gone once a
+** new game has started, and it only gets RECORD_MAGIC (and its flags
+** and length) once the end event is written. An input that the queue
+** has no room for (e.g. just after the game is saved) truncates the
+** recording.
+*/
+
+/* Guard band to ensure this definition is only included once */
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <inttypes.h>
+
+/* The size of the recording in EEPROM - what is left after the save
+** images and high score slots (the length byte allows up to 255)
+*/
+#define RECORD_SIZE 240
+#define RECORD_HEADER_LENGTH 14
+#define RECORD_MAGIC 'R'
+#define RECORD_VERSION 3
+
+/* Set if there wasn't room for all the inputs (the recording stops at
+** the first that didn't fit)
+*/
+#define RECORD_TRUNCATED 0x01
+
+/* The input of the end event, and what replay_input() returns when it
+** is reached
+*/
+#define RECORD_END 7
+
+typedef struct {
+	uint32_t lastTick;	/* the tick of the last event */
+	uint8_t length;		/* the length of the image so far (0 if unused) */
+	uint8_t flags;		/* the flags for the header */
+	uint8_t ended;		/* true once the end event has been added */
+} RecordingType;
+
+/* Start a recording of a game with the given seed and periods */
+void record_start(RecordingType* recording, uint32_t seed,
+		uint16_t movePeriod, uint16_t ratPeriod, uint16_t wallPeriod);
+
+/* Make the recording empty (e.g. for a game that can't be replayed
+** because it was loaded)
+*/
+void record_clear(RecordingType* recording);
+
+/* Returns true if the recording holds a game */
+uint8_t record_used(const RecordingType* recording);
+
+/* Add an input given at the given tick */
+void record_input(RecordingType* recording, uint32_t tick, int8_t input);
+
+/* Add the end event, at the given tick (if it hasn't been added) */
+void record_end(RecordingType* recording, uint32_t tick);
+
+/* Returns a CRC of the board layers and the score, to check that a
+** replay ends the same way as the game that was recorded
+*/
+uint16_t record_check(void);
+
+/* Print the recording image in EEPROM as a line of the form
+** "REC <hex bytes>". Returns 0 (and prints nothing) if there is no
+** finished recording in EEPROM.
+*/
+uint8_t dump_recording(void);
+
+/*
+** Replaying a recording. replay_open() reads the header of the
+** recording image (and returns 0 if it isn't a valid recording). Then
+** replay_input(), called with each tick in turn, returns the input for
+** that tick - GAME_NO_INPUT if there isn't one, or RECORD_END once the
+** end of the recording is reached (when endScore and endCheck are
+** filled in).
+*/
+typedef struct {
+	const uint8_t* next;	/* the next event */
+	const uint8_t* end;		/* the end of the image */
+	uint32_t tick;			/* the tick of the next event */
+	int8_t input;			/* the input of the next event */
+	uint8_t flags;
+	uint32_t seed;
+	uint16_t movePeriod;
+	uint16_t ratPeriod;
+	uint16_t wallPeriod;
+	uint16_t endScore;
+	uint16_t endCheck;
+} ReplayType;
+
+uint8_t replay_open(ReplayType* replay, const uint8_t* image,
+		uint16_t length);
+int8_t replay_input(ReplayType* replay, uint32_t tick);
+
+#endif
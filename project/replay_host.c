@@ -0,0 +1,163 @@
+/*
+** replay_host.c
+**
+** Replays a recorded game (see record.h) on a Linux host, tick for
+** tick through the game core, checks that it ends the way the recorded
+** game did, and reports how long the ticks take. The recording is the
+** "REC ..." line sent by the firmware (press 'R' before a game) or
+** written by snake_sim -r, so a set of recordings can be kept and
+** replayed as a performance regression check.
+**
+** Usage: snake_replay <recording file> [repeats]
+** (The timing is the mean over the repeats - 1000 by default.)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hal.h"
+#include "game.h"
+#include "record.h"
+#include "score.h"
+#include "eeprom_queue.h"
+
+/* Read the first "REC <hex bytes>" line of the file into image.
+** Returns the number of bytes read, or 0 if there isn't one.
+*/
+static uint16_t read_recording(FILE* file, uint8_t* image,
+		uint16_t size) {
+	char line[4 * RECORD_SIZE + 16];
+	char* hex;
+	unsigned int byte;
+	uint16_t length;
+
+	while(fgets(line, sizeof(line), file)) {
+		hex = strstr(line, "REC ");
+		if(!hex) {
+			continue;
+		}
+		hex += 4;
+		length = 0;
+		while(length < size && sscanf(hex, "%2x", &byte) == 1) {
+			image[length++] = byte;
+			hex += 2;
+		}
+		return length;
+	}
+	return 0;
+}
+
+static double elapsed_ns(const struct timespec* start,
+		const struct timespec* end) {
+	return (end->tv_sec - start->tv_sec) * 1e9 +
+			(end->tv_nsec - start->tv_nsec);
+}
+
+/* Start the recorded game */
+static void start_replay(ReplayType* replay, const uint8_t* image,
+		uint16_t length, GameState* game, RandomType* rng) {
+	replay_open(replay, image, length);
+	game_configure(game);
+	game->movePeriod = replay->movePeriod;
+	game->ratPeriod = replay->ratPeriod;
+	game->wallPeriod = replay->wallPeriod;
+	game_new(game, rng, replay->seed);
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t repeats = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000;
+	uint8_t image[RECORD_SIZE];
+	uint16_t length;
+	FILE* file;
+	ReplayType replay;
+	GameState game;
+	RandomType rng;
+	int8_t input;
+	int8_t result = 0;
+	uint32_t r;
+	uint32_t moves = 0;
+	double ns;
+	double moveNs = 0;
+	double worstNs = 0;
+	struct timespec start;
+	struct timespec end;
+	struct timespec tickStart;
+	struct timespec tickEnd;
+
+	if(argc < 2 || repeats == 0) {
+		fprintf(stderr, "Usage: snake_replay <recording file> [repeats]\n");
+		return 1;
+	}
+	file = fopen(argv[1], "r");
+	if(!file) {
+		perror(argv[1]);
+		return 1;
+	}
+	length = read_recording(file, image, sizeof(image));
+	fclose(file);
+	if(!replay_open(&replay, image, length)) {
+		fprintf(stderr, "%s: no recording found\n", argv[1]);
+		return 1;
+	}
+
+	hal_host_init(NULL, NULL);
+	init_eeprom_queue();
+	init_score();
+
+	/* Replay it once, timing each tick, and check how it ends. (The
+	** game can end early if the recording was truncated.)
+	*/
+	start_replay(&replay, image, length, &game, &rng);
+	while((input = replay_input(&replay, game.tick)) != RECORD_END &&
+			game.status >= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &tickStart);
+		result = game_step(&game, input, &rng);
+		clock_gettime(CLOCK_MONOTONIC, &tickEnd);
+		ns = elapsed_ns(&tickStart, &tickEnd);
+		if(ns > worstNs) {
+			worstNs = ns;
+		}
+		if(result != 0) {
+			moves++;
+			moveNs += ns;
+		}
+	}
+
+	printf("Seed %lu, periods (ticks): move %u, rats %u, walls %u\n",
+			(unsigned long)replay.seed, replay.movePeriod,
+			replay.ratPeriod, replay.wallPeriod);
+	printf("%lu ticks, %lu moves, score %u%s\n", (unsigned long)game.tick,
+			(unsigned long)moves, get_score(),
+			result < 0 ? ", game over" : "");
+	if(replay.flags & RECORD_TRUNCATED) {
+		printf("The recording was truncated - only the start of the "
+				"game was replayed\n");
+	} else if(get_score() == replay.endScore &&
+			record_check() == replay.endCheck) {
+		printf("Replay matches the recording\n");
+	} else {
+		printf("Replay DIFFERS from the recording (recorded score %u)\n",
+				replay.endScore);
+		return 2;
+	}
+
+	/* Then time it without the per tick timing */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(r = 0; r < repeats; r++) {
+		start_replay(&replay, image, length, &game, &rng);
+		while((input = replay_input(&replay, game.tick)) != RECORD_END &&
+				game.status >= 0) {
+			game_step(&game, input, &rng);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = elapsed_ns(&start, &end);
+
+	printf("%lu replays - %.1f ns/tick (including starting each game)\n",
+			(unsigned long)repeats,
+			game.tick ? ns / repeats / game.tick : 0.0);
+	printf("Ticks that moved the snake %.1f ns, the slowest tick %.0f ns\n",
+			moves ? moveNs / moves : 0.0, worstNs);
+	return 0;
+}
@@ -7,6 +7,9 @@
  */
 
 #include "savestate.h"
+#include "hal.h"
+#include "board.h"
+#include "position.h"
 
 /*for debugging
 #include "led_display.h"
@@ -15,34 +18,93 @@
 #include <avr/pgmspace.h>
 */
 
-uint16_t EEMEM ee_state_validation;
+/*
+** There are SAVE_SLOTS save slots, kept in SAVE_IMAGES images - one
+** more than the slots, so that a save is written to the spare image
+** and the slot's last save is only given up once all of the new one
+** is written. Each image holds a packed save, with a header:
+**	0-1	SAVE_MAGIC
+**	2	SAVE_VERSION
+**	3	length of the data that follows the header
+**	4	sequence number (one more than the newest save before it)
+**	5	slot
+**	6-7	score
+**	8-9	CRC16 of bytes 2-7 and the data
+** and then the data:
+**	0	current direction | next direction << 2
+**	1	snake length (n)
+**	2	snake tail position
+**	3-	n-1 2 bit direction codes (4 per byte, lowest bits first),
+**		the direction of each step from the tail to the head
+**	then	number of food items, and their positions
+** All multi-byte values are stored low byte first. The timers are
+** not saved - the game timers are periodic and restarted by 
+** new_game(), and none of them hold any game state.
+*/
+#define SAVE_MAGIC 0x4E53
+#define SAVE_VERSION 4
+#define SAVE_HEADER_LENGTH 10
+#define SAVE_MAX_DATA_LENGTH (3 + (MAX_SNAKE_SIZE + 2) / 4 + 1 + MAX_FOOD)
+#define SAVE_MAX_LENGTH (SAVE_HEADER_LENGTH + SAVE_MAX_DATA_LENGTH)
 
 /* EEPROM variables */
-//snake variables
-PosnType EEMEM ee_snakePositions[MAX_SNAKE_SIZE];
-int8_t EEMEM ee_snakeHeadIndex;
-int8_t EEMEM ee_snakeTailIndex;
-int8_t EEMEM ee_curSnakeDirn;
-int8_t EEMEM ee_nextSnakeDirn;
+uint8_t EEMEM ee_state[SAVE_IMAGES][SAVE_MAX_LENGTH];
 
-//food variables
-PosnType EEMEM ee_foodPositions[MAX_FOOD];
-int8_t EEMEM ee_numFoodItems;
+/* The save is streamed into the EEPROM queue as it is packed, and
+** read back straight from the EEPROM, so there is no copy of the
+** image in RAM. Only the bytes that have changed since the last save
+** to that slot are actually written. The save is longer than the
+** queue, so rather than wait for room save_step() queues as much as
+** fits each time it is called - packing the image again from the
+** start, which is quick, and queueing the part of it after the bytes
+** already queued. The game is paused while it is saved, so the image
+** is the same each time. The data is queued before the header, and
+** the slot's old image is cleared last.
+*/
+#define NO_SAVE 0xFF
 
-//score variables
-uint16_t EEMEM ee_score;
+typedef struct {
+	uint8_t index;	/* of the next byte packed */
+	uint8_t from;	/* the bytes from this index... */
+	uint8_t to;		/* ...up to (not including) this one are queued */
+	uint16_t crc;
+} PackType;
+
+/* The slot being saved (NO_SAVE if none), and the number of bytes of
+** the image (the data, then the header) queued so far. The image it
+** is saved to is spare_image(), which doesn't change until the save
+** is finished.
+*/
+static uint8_t savingSlot;
+static uint8_t savedBytes;
+
+/* The slot directory, read when the game starts and kept up to date
+** as the game is saved - which slots hold a valid save (bit n for
+** slot n), the image and score saved in each, and the slot and
+** sequence number of the newest save.
+*/
+#if SAVE_SLOTS > 8
+#error "usedSlots only has room for 8 slots"
+#endif
+
+static uint8_t usedSlots;
+static uint8_t slotImages[SAVE_SLOTS];
+static uint16_t slotScores[SAVE_SLOTS];
+static uint8_t newestSlot;
+static uint8_t newestSeq;
 
-//timer variables
-volatile uint16_t EEMEM ee_sw_timer_values[NUM_SW_TIMERS+1];
-volatile uint16_t EEMEM ee_sw_timer_target[NUM_SW_TIMERS+1];
-TimerFunctionType* EEMEM ee_sw_timer_functions[NUM_SW_TIMERS+1];
-volatile uint8_t EEMEM ee_sw_timer_once_only[NUM_SW_TIMERS+1];
+static uint8_t spare_image(void);
+static void clear_image(uint8_t image);
+static uint8_t image_byte(uint8_t image, uint8_t index);
+static void pack_data(PackType* pack, uint8_t snakeLength);
+static void put_data(PackType* pack, uint8_t data);
+static uint8_t read_image(uint8_t image);
+static uint8_t check_cells(uint8_t image, uint8_t snakeLength);
+static uint8_t claim_cell(uint16_t* cells, PosnType posn);
+static uint16_t image_crc(uint8_t image, uint8_t dataLength);
 
 /* external variables */
 //snake variables
-extern PosnType snakePositions[MAX_SNAKE_SIZE];
-extern int8_t snakeHeadIndex;
-extern int8_t snakeTailIndex;
 extern int8_t curSnakeDirn;
 extern int8_t nextSnakeDirn;
 
@@ -53,85 +115,361 @@ extern int8_t numFoodItems;
 //score variables
 extern uint16_t score;
 
-//clock variables
-extern uint16_t sw_timer_values[NUM_SW_TIMERS+1];
-extern uint16_t sw_timer_target[NUM_SW_TIMERS+1];
-extern TimerFunctionType* sw_timer_functions[NUM_SW_TIMERS+1];
-extern uint8_t sw_timer_once_only[NUM_SW_TIMERS+1];
+void init_save_slots(void){
+	uint8_t image;
+	uint8_t slot;
+	uint8_t seq;
 
-void save_state(void){
-	if(eeprom_read_word(&ee_state_validation) != 31415)
-		eeprom_write_word(&ee_state_validation, 31415);
+	/* Don't read an image while it is still being written */
+	eeprom_queue_wait();
+	savingSlot = NO_SAVE;
+	usedSlots = 0;
+	newestSlot = 0;
+	newestSeq = 0;
+	for(image = 0; image < SAVE_IMAGES; image++){
+		if(!read_image(image))
+			continue;
+		slot = image_byte(image, 5);
+		seq = image_byte(image, 4);
+		if(save_slot_used(slot)){
+			//a save was cut off after its header was written, but
+			//before the slot's old image was cleared - keep the newer
+			if((int8_t)(seq - image_byte(slotImages[slot], 4)) < 0){
+				clear_image(image);
+				continue;
+			}
+			clear_image(slotImages[slot]);
+		}
+		slotImages[slot] = image;
+		slotScores[slot] = image_byte(image, 6) | (image_byte(image, 7) << 8);
+		if(!usedSlots || (int8_t)(seq - newestSeq) > 0){
+			newestSlot = slot;
+			newestSeq = seq;
+		}
+		usedSlots |= 1 << slot;
+	}
+}
+
+uint8_t save_slot_used(uint8_t slot){
+	return (usedSlots >> slot) & 1;
+}
+
+uint16_t save_slot_score(uint8_t slot){
+	return slotScores[slot];
+}
+
+uint8_t newest_save_slot(void){
+	return newestSlot;
+}
+
+uint8_t save_state(uint8_t slot){
+	if(savingSlot != NO_SAVE){
+		/* The last save is still being queued */
+		return 0;
+	}
+	commit_highscore();
+	savingSlot = slot;
+	savedBytes = 0;
+	save_step();
+	return 1;
+}
 
-	/* Recall: typedef uint8_t PosnType;
-	**	       eeprom_write_block(const void *  __src, void *  __dst, size_t  __n)
-	** 		   eeprom_write_word(uint16_t * __p, value);
-	*/
+uint8_t save_step(void){
+	uint8_t header[SAVE_HEADER_LENGTH];
+	uint8_t snakeLength;
+	uint8_t length;
+	uint8_t room;
+	uint8_t image;
+	uint8_t seq;
+	uint8_t i;
+	PackType pack;
+
+	if(savingSlot == NO_SAVE)
+		return 0;
+	room = eeprom_queue_room();
+	if(!room)
+		return 1;
+	image = spare_image();
+
+	//header - the CRC is worked out as the data is packed
+	snakeLength = get_snake_length();
+	length = 3 + (snakeLength + 2) / 4 + 1 + numFoodItems;
+	seq = newestSeq + 1;
+	header[0] = (uint8_t)SAVE_MAGIC;
+	header[1] = (uint8_t)(SAVE_MAGIC >> 8);
+	header[2] = SAVE_VERSION;
+	header[3] = length;
+	header[4] = seq;
+	header[5] = savingSlot;
+	header[6] = (uint8_t)score;
+	header[7] = (uint8_t)(score >> 8);
+	pack.crc = 0xFFFF;
+	for(i = 2; i < 8; i++)
+		pack.crc = _crc16_update(pack.crc, header[i]);
+
+	//the next part of the data, if it isn't all queued
+	pack.index = 0;
+	pack.from = savedBytes;
+	pack.to = savedBytes + room;
+	if(pack.to > length)
+		pack.to = length;
+	if(savedBytes < length)
+		eeprom_queue_start(&ee_state[image][SAVE_HEADER_LENGTH + savedBytes]);
+	pack_data(&pack, snakeLength);
+	if(savedBytes < length){
+		eeprom_queue_finish();
+		savedBytes = pack.to;
+		return 1;
+	}
+
+	//then the header, so the image only becomes valid once all of
+	//the data is written
+	i = savedBytes - length;
+	if(i < SAVE_HEADER_LENGTH){
+		header[8] = (uint8_t)pack.crc;
+		header[9] = (uint8_t)(pack.crc >> 8);
+		eeprom_queue_start(&ee_state[image][i]);
+		for(; i < SAVE_HEADER_LENGTH && room; i++, room--)
+			eeprom_queue_put(header[i]);
+		eeprom_queue_finish();
+		savedBytes = length + i;
+		return 1;
+	}
+
+	//and last, the slot's old image is cleared (there is room for
+	//the byte) - until then both are valid, and init_save_slots()
+	//keeps the newer
+	if(save_slot_used(savingSlot))
+		clear_image(slotImages[savingSlot]);
+
+	/* The directory describes the slot as it will be once written */
+	usedSlots |= 1 << savingSlot;
+	slotImages[savingSlot] = image;
+	slotScores[savingSlot] = score;
+	newestSlot = savingSlot;
+	newestSeq = seq;
+	savingSlot = NO_SAVE;
+	return 0;
+}
+
+int8_t load_state(uint8_t slot){
+	uint8_t image;
+	uint8_t at;
+	uint8_t snakeLength;
+	uint8_t shift;
+	int8_t i;
+
+	if(!save_slot_used(slot))
+		return 0;
+
+	/* Make sure any save has finished before reading it back */
+	eeprom_queue_wait();
+	image = slotImages[slot];
+	if(!read_image(image))
+		return 0;
+
+	//score variables
+	score = image_byte(image, 6) | (image_byte(image, 7) << 8);
 
 	//snake variables
-	eeprom_write_block((const void*)&snakePositions, (void*)&ee_snakePositions, MAX_SNAKE_SIZE);
-	eeprom_write_byte((uint8_t *)&ee_snakeHeadIndex, snakeHeadIndex);
-	eeprom_write_byte((uint8_t *)&ee_snakeTailIndex, snakeTailIndex);
-	eeprom_write_byte((uint8_t *)&ee_curSnakeDirn, curSnakeDirn);
-	eeprom_write_byte((uint8_t *)&ee_nextSnakeDirn, nextSnakeDirn);
+	at = SAVE_HEADER_LENGTH;
+	snakeLength = image_byte(image, at + 1);
+	curSnakeDirn = image_byte(image, at) & 0x03;
+	nextSnakeDirn = (image_byte(image, at) >> 2) & 0x03;
+	set_snake_tail(image_byte(image, at + 2));
+	at += 3;
+	shift = 0;
+	for(i = 1; i < snakeLength; i++){
+		extend_snake((image_byte(image, at) >> shift) & 0x03);
+		shift += 2;
+		if(shift == 8){
+			shift = 0;
+			at++;
+		}
+	}
+	if(shift)
+		at++;
 
 	//food variables
-	eeprom_write_block((const void*)&foodPositions, (void*)&ee_foodPositions, MAX_FOOD);
-	eeprom_write_byte((uint8_t *)&ee_numFoodItems, numFoodItems);
+	numFoodItems = image_byte(image, at++);
+	for(i = 0; i < numFoodItems; i++)
+		foodPositions[i] = image_byte(image, at++);
 
-	//score variables
-	eeprom_write_word(&ee_score, score);
+	//walls are not saved, and the board occupancy is
+	//rebuilt when the loaded state is rendered
+	init_walls();
 
-	//timer variables
-	eeprom_write_block((const void*)&sw_timer_values, (void*)&ee_sw_timer_values, NUM_SW_TIMERS+1);
-	eeprom_write_block((const void*)&sw_timer_target, (void*)&ee_sw_timer_target, NUM_SW_TIMERS+1);
-	eeprom_write_block((const void*)&sw_timer_functions, (void*)&ee_sw_timer_functions, NUM_SW_TIMERS+1);
-	eeprom_write_block((const void*)&sw_timer_once_only, (void*)&ee_sw_timer_once_only, NUM_SW_TIMERS+1);
+	return 1;
+}
+
+/* The first image that no slot is using */
+static uint8_t spare_image(void){
+	uint8_t image;
+	uint8_t slot;
+
+	for(image = 0; ; image++){
+		for(slot = 0; slot < SAVE_SLOTS; slot++){
+			if(save_slot_used(slot) && slotImages[slot] == image)
+				break;
+		}
+		if(slot == SAVE_SLOTS)
+			return image;
+	}
+}
+
+/* Queue a write that makes the given image invalid. Only called when
+** the queue has room for it.
+*/
+static void clear_image(uint8_t image){
+	uint8_t clear = 0;
+	eeprom_queue_write(ee_state[image], &clear, 1);
+}
 
-	/*for debugging
-	move_cursor(1,20);
-	printf_P(PSTR("Snake Positions:"));
+/* Read a byte of the given image */
+static uint8_t image_byte(uint8_t image, uint8_t index){
+	return eeprom_read_byte(&ee_state[image][index]);
+}
+
+/* Pack the data of the save, adding each byte to the CRC and queueing
+** the bytes from pack->from up to pack->to
+*/
+static void pack_data(PackType* pack, uint8_t snakeLength){
+	uint8_t shift;
+	uint8_t dirns;
 	int8_t i;
-	for(i = 0; i < MAX_SNAKE_SIZE; i++)	
-		printf_P(PSTR(" %u"), snakePositions[i] );
-	*/
-}
-
-int8_t load_state(void){
-	if(eeprom_read_word(&ee_state_validation) == 31415){
-		/* Recall: typedef uint8_t PosnType;
-		** 		   eeprom_read_block( void *  __dst, const void *  __src, size_t  __n    )
-		**		   uint16_t eeprom_read_word( const uint16_t *__p) 
-		*/
-
-		//snake variables
-		eeprom_read_block((void*)&snakePositions, (const void*)&ee_snakePositions, MAX_SNAKE_SIZE);
-		snakeHeadIndex = (int8_t)eeprom_read_byte((const uint8_t *)&ee_snakeHeadIndex);
-		snakeTailIndex = (int8_t)eeprom_read_byte((const uint8_t *)&ee_snakeTailIndex);
-		curSnakeDirn = (int8_t)eeprom_read_byte((const uint8_t *)&ee_curSnakeDirn);
-		nextSnakeDirn = (int8_t)eeprom_read_byte((const uint8_t *)&ee_nextSnakeDirn);
-
-		//food variables
-		eeprom_read_block((void*)&foodPositions, (const void*)&ee_foodPositions, MAX_FOOD);
-		numFoodItems = (int8_t)eeprom_read_byte((const uint8_t *)&ee_numFoodItems);
-
-		//score variables
-		score = eeprom_read_word((const uint16_t *)&ee_score);
-
-		//timer variables
-		eeprom_read_block((void*)&sw_timer_values, (const void*)&ee_sw_timer_values, NUM_SW_TIMERS+1);
-		eeprom_read_block((void*)&sw_timer_target, (const void*)&ee_sw_timer_target, NUM_SW_TIMERS+1);
-		eeprom_read_block((void*)&sw_timer_functions, (const void*)&ee_sw_timer_functions, NUM_SW_TIMERS+1);
-		eeprom_read_block((void*)&sw_timer_once_only, (const void*)&ee_sw_timer_once_only, NUM_SW_TIMERS+1);
-
-		/*for debugging
-		move_cursor(1,20);
-		printf_P(PSTR("Snake Positions:"));
-		int8_t i;
-		for(i = 0; i < MAX_SNAKE_SIZE; i++)	
-			printf_P(PSTR(" %u"), snakePositions[i] );
-		*/
-		return 1;
-	} else
+	SnakeIteratorType segment;
+
+	//snake variables
+	put_data(pack, curSnakeDirn | (nextSnakeDirn << 2));
+	put_data(pack, snakeLength);
+	first_snake_segment(&segment);
+	put_data(pack, segment.posn);
+	shift = 0;
+	dirns = 0;
+	while(next_snake_segment(&segment)){
+		dirns |= segment.dirn << shift;
+		shift += 2;
+		if(shift == 8){
+			put_data(pack, dirns);
+			shift = 0;
+			dirns = 0;
+		}
+	}
+	if(shift)
+		put_data(pack, dirns);
+
+	//food variables
+	put_data(pack, numFoodItems);
+	for(i = 0; i < numFoodItems; i++)
+		put_data(pack, foodPositions[i]);
+}
+
+/* Add the next byte of the data to the CRC, and queue it if it is in
+** the part being queued
+*/
+static void put_data(PackType* pack, uint8_t data){
+	pack->crc = _crc16_update(pack->crc, data);
+	if(pack->index >= pack->from && pack->index < pack->to)
+		eeprom_queue_put(data);
+	pack->index++;
+}
+
+/* Check the given image. Returns 1 if it has the right magic number,
+** version, slot number and CRC, its lengths agree and its cells are
+** all on the board and don't overlap, otherwise 0.
+*/
+static uint8_t read_image(uint8_t image){
+	uint8_t length;
+	uint8_t snakeLength;
+	uint8_t directionBytes;
+	uint8_t numFood;
+
+	length = image_byte(image, 3);
+	if(image_byte(image, 0) != (uint8_t)SAVE_MAGIC || 
+			image_byte(image, 1) != (uint8_t)(SAVE_MAGIC >> 8) ||
+			image_byte(image, 2) != SAVE_VERSION || length > SAVE_MAX_DATA_LENGTH ||
+			image_byte(image, 5) >= SAVE_SLOTS)
+		return 0;
+	if(image_crc(image, length) != (image_byte(image, 8) | (image_byte(image, 9) << 8)))
+		return 0;
+
+	snakeLength = image_byte(image, SAVE_HEADER_LENGTH + 1);
+	if(snakeLength < 1 || snakeLength > MAX_SNAKE_SIZE)
+		return 0;
+	directionBytes = (snakeLength + 2) / 4;
+	if(length < 4 + directionBytes)
+		return 0;
+	numFood = image_byte(image, SAVE_HEADER_LENGTH + 3 + directionBytes);
+	if(numFood > MAX_FOOD || length != 4 + directionBytes + numFood)
+		return 0;
+	return check_cells(image, snakeLength);
+}
+
+/* Check each cell of the image data - the snake from the tail to the
+** head, then the food - the same way load_state() will decode it.
+** A CRC only shows that the image is what was saved, so this stops a
+** bad save (e.g. from a bug) putting cells off the board or on top of
+** each other. Returns 1 if the cells are good.
+*/
+static uint8_t check_cells(uint8_t image, uint8_t snakeLength){
+	uint16_t cells[BOARD_WIDTH];
+	PosnType posn;
+	uint8_t at;
+	uint8_t shift;
+	uint8_t numFood;
+	uint8_t i;
+
+	for(i = 0; i < BOARD_WIDTH; i++)
+		cells[i] = 0;
+
+	//snake - bit 7 only marks rats
+	at = SAVE_HEADER_LENGTH;
+	posn = image_byte(image, at + 2);
+	if((posn & 0x80) || !claim_cell(cells, posn))
+		return 0;
+	at += 3;
+	shift = 0;
+	for(i = 1; i < snakeLength; i++){
+		posn = step_position(posn, (image_byte(image, at) >> shift) & 0x03);
+		if(!claim_cell(cells, posn))
+			return 0;
+		shift += 2;
+		if(shift == 8){
+			shift = 0;
+			at++;
+		}
+	}
+	if(shift)
+		at++;
+
+	//food (and rats)
+	numFood = image_byte(image, at++);
+	for(i = 0; i < numFood; i++){
+		if(!claim_cell(cells, image_byte(image, at++) & 0x7F))
+			return 0;
+	}
+	return 1;
+}
+
+/* Mark the cell as used. Returns 0 if it is off the board or already
+** used.
+*/
+static uint8_t claim_cell(uint16_t* cells, PosnType posn){
+	uint8_t x = x_position(posn);
+	uint8_t y = y_position(posn);
+	if(is_off_board(x, y) || (cells[x] & (1U << y)))
 		return 0;
+	cells[x] |= 1U << y;
+	return 1;
+}
+
+/* CRC16 of header bytes 2 to 7 and the data of the given image */
+static uint16_t image_crc(uint8_t image, uint8_t dataLength){
+	uint16_t crc = 0xFFFF;
+	uint8_t i;
+	for(i = 2; i < 8; i++)
+		crc = _crc16_update(crc, image_byte(image, i));
+	for(i = 0; i < dataLength; i++)
+		crc = _crc16_update(crc, image_byte(image, SAVE_HEADER_LENGTH + i));
+	return crc;
 }
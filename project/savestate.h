@@ -7,7 +7,7 @@
  */
 
 #include <stdint.h>
-#include <avr/eeprom.h>
+#include "hal.h"
 
 //these hold datastructures we need to copy
 #include "snake.h"
@@ -15,7 +15,41 @@
 #include "wall.h"
 #include "timer.h"
 #include "score.h"
+#include "eeprom_queue.h"
 
+/* Number of save slots, and the images in EEPROM they are kept in -
+ * one spare, which each save is written to, so that a save that is
+ * cut off (e.g. by a reset) leaves the slot's last save as it was.
+ * (Each image takes up to 10 + 4 + (MAX_SNAKE_SIZE + 2) / 4 + MAX_FOOD
+ * bytes of EEPROM.)
+ */
+#define SAVE_SLOTS 4
+#define SAVE_IMAGES (SAVE_SLOTS + 1)
+
+/* init_save_slots() reads the header of each save slot into a
+ * directory in RAM, so the slots can be listed without reading the
+ * EEPROM again. Call it once when the program starts.
+ * save_slot_used() and save_slot_score() describe a slot (numbered
+ * from 0), and newest_save_slot() returns the slot saved most 
+ * recently (0 if none are used).
+ */
+void init_save_slots(void);
+uint8_t save_slot_used(uint8_t slot);
+uint16_t save_slot_score(uint8_t slot);
+uint8_t newest_save_slot(void);
 
-void save_state(void);
-int8_t load_state(void);
+/* save_state() starts saving the game state to the given slot. It is
+ * queued to be written to EEPROM in the background (see
+ * eeprom_queue.h) a part at a time, as the queue has room, so nothing
+ * waits for the EEPROM - save_state() queues the first part, and
+ * save_step() queues the next part each time it is called, returning
+ * 1 until all of the save is queued. The game must stay paused until
+ * then. save_state() returns 0 (and saves nothing) if the last save
+ * is still being queued. The save is complete once
+ * eeprom_queue_idle() is true after that.
+ * load_state() returns 0 (and loads nothing) if the slot doesn't
+ * hold a valid save.
+ */
+uint8_t save_state(uint8_t slot);
+uint8_t save_step(void);
+int8_t load_state(uint8_t slot);
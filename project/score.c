@@ -5,39 +5,134 @@
 */
 
 #include <stdint.h>
-#include <avr/eeprom.h>
+#include "hal.h"
 #include "terminalio.h"
+#include "serialio.h"
+#include "score.h"
+#include "eeprom_queue.h"
 #include <stdio.h>
-#include <avr/pgmspace.h>
+
+/* The most bytes written to the terminal to draw the score line
+** (cursor move, label and 5 digits) and the high score line. Each
+** must fit in the serial output buffer.
+*/
+#define SCORE_TEXT_LENGTH 18
+#define HIGHSCORE_TEXT_LENGTH 23
+
+#if HIGHSCORE_TEXT_LENGTH > OUTPUT_BUFFER_SIZE
+#error "The serial output buffer is too small to refresh the high score"
+#endif
+
+/* The lines that are out of date (in scoreChanged) */
+#define SCORE_LINE 0x01
+#define HIGHSCORE_LINE 0x02
+
+static const char scoreLabel[] PROGMEM = "Score: ";
+static const char highScoreLabel[] PROGMEM = "High Score: ";
 
 uint16_t score;	/* Can represent values from 0 to 65535 */
 
+/* The high score is kept in EEPROM in a ring of slots. Each commit
+** writes the next slot with the next sequence number, so the writes
+** are spread over all the slots. check is ~(seq ^ both score bytes),
+** so a blank (all 0xFF or all 0x00) or partly written slot is not
+** valid.
+*/
+#define HIGHSCORE_SLOTS 8
+
+typedef struct {
+	uint16_t highscore;
+	uint8_t seq;
+	uint8_t check;
+} HighScoreSlotType;
+
 //4209435
-uint16_t EEMEM ee_highscore;
-uint16_t EEMEM ee_score_validation;
+HighScoreSlotType EEMEM ee_highscoreSlots[HIGHSCORE_SLOTS];
 uint16_t highscore; /* this will save the current highscore in program memory */
+uint8_t highscoreChanged; /* true if highscore hasn't been committed */
+uint8_t highscoreSlot; /* the slot holding the newest high score */
+uint8_t highscoreSeq; /* the sequence number of that slot */
+uint8_t scoreChanged; /* the lines of the display that are out of date */
+
+static uint8_t slot_check(HighScoreSlotType* slot);
+static void draw_score_line(void);
+static void draw_highscore_line(void);
 
 void init_score(void) {
-	score = 0;
+	uint8_t i;
+	uint8_t found;
+	HighScoreSlotType slot;
+
+	reset_score();
 
-	if(eeprom_read_word(&ee_score_validation) != 31415){
-		eeprom_write_word(&ee_score_validation, 31415);
-		eeprom_write_word(&ee_highscore, 0);
-		highscore = 0;
+	/* Don't read the slots while one is still being written */
+	eeprom_queue_wait();
+
+	/* Find the valid slot with the newest sequence number. (The
+	** sequence numbers of the slots are within HIGHSCORE_SLOTS of
+	** each other, so we can compare them across the wrap around.)
+	*/
+	found = 0;
+	highscore = 0;
+	highscoreSlot = HIGHSCORE_SLOTS - 1;
+	highscoreSeq = 0;
+	for(i = 0; i < HIGHSCORE_SLOTS; i++) {
+		eeprom_read_block((void*)&slot, (const void*)&ee_highscoreSlots[i], sizeof(slot));
+		if(slot.check != slot_check(&slot)) {
+			continue;
+		}
+		if(!found || (int8_t)(slot.seq - highscoreSeq) > 0) {
+			found = 1;
+			highscoreSeq = slot.seq;
+			highscore = slot.highscore;
+			highscoreSlot = i;
+		}
 	}
-	else
-		highscore = eeprom_read_word(&ee_highscore);
+	highscoreChanged = 0;
+}
 
+void commit_highscore(void) {
+	HighScoreSlotType slot;
+	uint8_t next;
+
+	if(!highscoreChanged) {
+		return;
+	}
+	next = highscoreSlot + 1;
+	if(next == HIGHSCORE_SLOTS) {
+		next = 0;
+	}
+	slot.seq = highscoreSeq + 1;
+	slot.highscore = highscore;
+	slot.check = slot_check(&slot);
+	/* The queue copies the slot. If it's full, we try again next time. */
+	if(eeprom_queue_write(&ee_highscoreSlots[next], &slot, sizeof(slot))) {
+		highscoreSlot = next;
+		highscoreSeq = slot.seq;
+		highscoreChanged = 0;
+	}
 }
 
+static uint8_t slot_check(HighScoreSlotType* slot) {
+	return ~(slot->seq ^ (uint8_t)slot->highscore ^ (uint8_t)(slot->highscore >> 8));
+}
+
+
+void reset_score(void) {
+	score = 0;
+	scoreChanged = SCORE_LINE | HIGHSCORE_LINE;
+}
 
 void add_to_score(uint16_t value) {
 	score += value;
+	scoreChanged |= SCORE_LINE;
 
 	//4209435
 	if(highscore <= score){
-		eeprom_write_word(&ee_highscore, score);
+		/* Only written to EEPROM by commit_highscore() */
 		highscore = score;
+		highscoreChanged = 1;
+		scoreChanged |= HIGHSCORE_LINE;
 	}
 }
 
@@ -50,10 +145,23 @@ uint16_t get_highscore() {
 	return highscore;
 }
 
+/* Redraw each line of the score only if it has changed and the
+** serial output buffer has room for all of it, so this never waits
+** for the UART. (If there isn't room, we try again next time.)
+*/
+void refresh_score(void){
+	if((scoreChanged & SCORE_LINE) && serial_space() >= SCORE_TEXT_LENGTH) {
+		draw_score_line();
+	}
+	if((scoreChanged & HIGHSCORE_LINE) && 
+			serial_space() >= HIGHSCORE_TEXT_LENGTH) {
+		draw_highscore_line();
+	}
+}
+
 void update_score(void){
-	move_cursor(1,1);
-	printf_P(PSTR("Score: %u\n"), get_score());
-	printf_P(PSTR("High Score: %u"), get_highscore());
+	draw_score_line();
+	draw_highscore_line();
 
 /*	move_cursor(8,1);
 	clear_to_end_of_line();
@@ -69,3 +177,17 @@ void update_score(void){
 	wait_for(1000);
 	//*/
 }
+
+static void draw_score_line(void){
+	scoreChanged &= ~SCORE_LINE;
+	move_cursor(1,1);
+	serial_write_P(scoreLabel, sizeof(scoreLabel) - 1);
+	print_unsigned(get_score());
+}
+
+static void draw_highscore_line(void){
+	scoreChanged &= ~HIGHSCORE_LINE;
+	move_cursor(1,2);
+	serial_write_P(highScoreLabel, sizeof(highScoreLabel) - 1);
+	print_unsigned(get_highscore());
+}
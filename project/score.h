@@ -9,14 +9,30 @@
 #define SCORE_H
 
 #include <inttypes.h>
-#include <avr/eeprom.h>
+#include "hal.h"
 
 void init_score(void);
+/* Sets the score to 0 for a new game (leaving the high score alone) */
+void reset_score(void);
 void add_to_score(uint16_t value);
 uint16_t get_score(void);
 
 //4209435
 uint16_t get_highscore(void);
+
+/* The high score is only kept in RAM as the score goes up. 
+** commit_highscore() writes it to EEPROM (in the background - see
+** eeprom_queue.h) if it has changed - call it at the end of a game
+** and when the game is saved. init_score() reads it back.
+*/
+void commit_highscore(void);
+
+/* update_score() draws the score and high score on the terminal.
+** refresh_score() only does so if the score has changed since it
+** was last drawn and it can be drawn without waiting for the serial
+** port - call it from the game loop.
+*/
 void update_score(void);
+void refresh_score(void);
 
 #endif
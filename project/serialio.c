@@ -3,65 +3,72 @@
  *
  * Written by Peter Sutton.
  * 
- * Module to allow standard input/output routines to be used via 
- * serial port. The init_serial_stdio() method must be called before
- * any standard IO methods (e.g. printf). We use interrupt-based output
+ * Module to do input/output via the serial port. The
+ * init_serial_stdio() method must be called before any of the other
+ * methods. (The stdio streams are not used - an avr-libc FILE
+ * and its stdin/stdout/stderr pointers take 20 bytes of RAM that the
+ * game needs, and printf is not used anyway.) We use interrupt-based output
  * and a circular buffer to store output messages. (This allows us 
  * to print many characters at once to the buffer and have them 
  * output by the UART as speed permits.) If the buffer fills up, the
- * put method will block until there is room in it. 
- * Input is polling based - requesting input from stdin will block
- * until a character is available.
+ * put method will block until there is room in it. The buffers are
+ * single-producer/single-consumer rings, so neither the put nor the
+ * get method needs to disable interrupts.
+ * Input is polling based - serial_get_char() will block until a
+ * character is available.
  * The function input_available() can be used to test whether there is
- * input available to read from stdin.
+ * input available to read.
  *
  */
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <stdio.h>
+#include "hal.h"
+#include "serialio.h"
 
-/* Clock rate in Hz. (The L at the end makes this a long constant (32 bit)
-** as opposed to an integer constant (16 bit).) */
-#define SYSCLK 4000000L
+#if (OUTPUT_BUFFER_SIZE & (OUTPUT_BUFFER_SIZE - 1)) || OUTPUT_BUFFER_SIZE > 128
+#error "OUTPUT_BUFFER_SIZE must be a power of 2 no greater than 128"
+#endif
+#if (INPUT_BUFFER_SIZE & (INPUT_BUFFER_SIZE - 1)) || INPUT_BUFFER_SIZE > 128
+#error "INPUT_BUFFER_SIZE must be a power of 2 no greater than 128"
+#endif
 
 /* Global variables */
 /* 
-** Circular buffer to hold outgoing characters. The insert_pos variable
-** keeps track of the position (0 to OUTPUT_BUFFER_SIZE-1) that the next
-** outgoing character should be written to. bytes_in_buffer keeps
-** count of the number of characters currently stored in the buffer 
-** (ranging from 0 to OUTPUT_BUFFER_SIZE). This number of bytes immediately
-** prior to the current insert_pos are the bytes waiting to be output.
-** If the insert_pos reaches the end of the buffer it will wrap around
-** to the beginning (assuming those bytes have been output).
+** Circular buffer to hold outgoing characters. out_head counts the
+** characters put into the buffer and is only written by the main
+** program. out_tail counts the characters taken out and is only 
+** written by the ISR that outputs them. Both wrap around at 256, so
+** (out_head - out_tail) is the number of characters waiting and 
+** masking a count with (OUTPUT_BUFFER_SIZE-1) gives its position in
+** the buffer. Because each side only writes its own index, neither
+** side needs to disable interrupts.
 */
-#define OUTPUT_BUFFER_SIZE 32
 volatile char out_buffer[OUTPUT_BUFFER_SIZE];
-volatile unsigned char out_insert_pos;
-volatile unsigned char bytes_in_out_buffer;
+volatile uint8_t out_head;
+volatile uint8_t out_tail;
 
 /*
 ** Circular buffer to hold incoming characters. Works on same principle
-** as output buffer
+** as output buffer, except that input_head is written by the ISR
+** which receives characters, and input_tail by the main program.
 */
-#define INPUT_BUFFER_SIZE 16
 volatile char input_buffer[INPUT_BUFFER_SIZE];
-volatile unsigned char input_insert_pos;
-volatile unsigned char bytes_in_input_buffer;
+volatile uint8_t input_head;
+volatile uint8_t input_tail;
 volatile unsigned char input_overrun;
 
+/* Counts of bytes that serial_write() had to wait for and that
+** serial_try_write() did not buffer - see comment in header file
+*/
+uint16_t serial_bytes_deferred;
+uint16_t serial_bytes_dropped;
+
 /* Function prototypes */
 
 void init_serial_stdio(long baudrate, char echo);
-static int uart_put_char(char, FILE*);
-static int uart_get_char(FILE*);
-
-/* Setup a stream that uses the uart get and put functions. We will
-** make standard input and output use this stream below.
-*/
-static FILE myStream = FDEV_SETUP_STREAM(uart_put_char, uart_get_char,
-		_FDEV_SETUP_RW);
+static uint8_t buffer_bytes(const char* data, uint8_t length, 
+		uint8_t fromProgmem);
+static void write_bytes(const char* data, uint8_t length, 
+		uint8_t fromProgmem);
 
 /* Global variables */
 char do_echo;
@@ -70,10 +77,10 @@ void init_serial_stdio(long baudrate, char echo) {
 	/*
 	** Initialise our buffers
 	*/
-	out_insert_pos = 0;
-	bytes_in_out_buffer = 0;
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
+	out_head = 0;
+	out_tail = 0;
+	input_head = 0;
+	input_tail = 0;
 	input_overrun = 0;
 	
 	/*
@@ -81,37 +88,17 @@ void init_serial_stdio(long baudrate, char echo) {
 	*/
 	do_echo = echo;
 	
-	/* Configure the serial port baud rate */
-	/* (This differs from the datasheet formula so that we get 
-	** rounding to the nearest integer while using integer division
-	** (which truncates)).
-	*/
-	UBRR = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
-	
 	/*
-	** Enable transmission and receiving via UART. We don't enable
-	** the UDR empty interrupt here (we wait until we've got a
-	** character to transmit).
+	** Set up the UART. It doesn't ask for characters to transmit
+	** until we've got one.
 	** NOTE: Interrupts must be enabled globally for this
 	** library to work, but we do not do this here.
 	*/
-	UCR = (1<<RXEN)|(1<<TXEN);
-	
-	/*
-	** Enable receive complete interrupt 
-	*/
-	UCR  |= (1 <<RXCIE);
-
-	/* Set up our stream so the put and get functions below are used 
-	** to write/read characters via the serial port when we use
-	** stdio functions
-	*/
-	stdout = &myStream;
-	stdin = &myStream;
+	hal_uart_init(baudrate);
 }
 
-static int uart_put_char(char c, FILE* stream) {
-	unsigned char interrupts_enabled;
+void serial_put_char(char c) {
+	uint8_t head;
 	
 	/* Add the character to the buffer for transmission (if there 
 	** is space to do so). If not we wait until the buffer has space.
@@ -119,111 +106,148 @@ static int uart_put_char(char c, FILE* stream) {
 	** also.
 	*/
 	if(c == '\n') {
-		uart_put_char('\r', stream);
+		serial_put_char('\r');
 	}
 	
 	/* 
-	** Loop until the buffer has enough space. The bytes_in_buffer
+	** Loop until the buffer has enough space. The out_tail
 	** variable will get modified by the ISR which extracts bytes
 	** from the buffer.
 	*/
-	while(bytes_in_out_buffer >= OUTPUT_BUFFER_SIZE) {
+	head = out_head;
+	while((uint8_t)(head - out_tail) >= OUTPUT_BUFFER_SIZE) {
 		/* do nothing */
 	}
 	
-	/* Add the character to the buffer for transmission if there
-	** is space to do so. We advance the insert_pos to the next
-	** character position. If this is beyond the end of the buffer
-	** we wrap around back to the beginning of the buffer 
-	** NOTE: we disable interrupts before modifying the buffer. This
-	** prevents the ISR from modifying the buffer at the same time.
-	** We reenable them if they were enabled when we entered the
-	** function.
+	/* Add the character to the buffer, then advance out_head so
+	** the ISR can see it. 
 	*/
-	
-	interrupts_enabled = bit_is_set(SREG, SREG_I);
-	cli();
-	out_buffer[out_insert_pos++] = c;
-	bytes_in_out_buffer++;
-	if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
-		/* Wrap around buffer pointer if necessary */
-		out_insert_pos = 0;
-	}
-	/* Reenable interrupts (UDR Empty interrupt may have been
-	** disabled */
-	UCR |= (1 << UDRIE);
-	if(interrupts_enabled) {
-		sei();
+	out_buffer[head & (OUTPUT_BUFFER_SIZE - 1)] = c;
+	out_head = head + 1;
+
+	/* Make sure the UDR Empty interrupt is enabled (the ISR disables
+	** it when the buffer empties). On the AVR this is a single (atomic)
+	** bit set instruction.
+	*/
+	hal_uart_tx_interrupt(1);
+}
+
+void serial_puts_P(const char* string) {
+	char c;
+
+	while((c = pgm_read_byte(string++))) {
+		serial_put_char(c);
 	}
-	return 0;
 }
 
-int uart_get_char(FILE* stream) {
+char serial_get_char(void) {
+	uint8_t tail;
+	char c;
+
 	/* Wait until we've received a character */
-	while(bytes_in_input_buffer == 0) {
+	tail = input_tail;
+	while(input_head == tail) {
 		/* do nothing */
 	}
 	
 	/*
-	** Turn interrupts off and remove a character from the input
-	** buffer. We reenable interrupts if they were on.
-	** The pending character is the one which is byte_in_input_buffer
-	** characters before the insert position (taking into account
-	** that we may need to wrap around).
+	** Take the oldest character, then advance input_tail to
+	** free its place in the buffer.
 	*/
-	unsigned char interrupts_enabled = bit_is_set(SREG, SREG_I);
-	cli();
-	char c;
-	if(input_insert_pos - bytes_in_input_buffer < 0) {
-		/* Need to wrap around */
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer
-				+ INPUT_BUFFER_SIZE];
-	} else {
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer];
-	}
-	
-	/* Decrement our count of bytes in the input buffer */
-	bytes_in_input_buffer--;
-	if(interrupts_enabled) {
-		sei();
-	}	
+	c = input_buffer[tail & (INPUT_BUFFER_SIZE - 1)];
+	input_tail = tail + 1;
 	return c;
 }
 
 int8_t input_available(void) {
-	return (bytes_in_input_buffer != 0);
+	return (input_head != input_tail);
+}
+
+uint8_t serial_space(void) {
+	return OUTPUT_BUFFER_SIZE - (uint8_t)(out_head - out_tail);
+}
+
+void serial_write(const char* data, uint8_t length) {
+	write_bytes(data, length, 0);
+}
+
+void serial_write_P(const char* data, uint8_t length) {
+	write_bytes(data, length, 1);
+}
+
+uint8_t serial_try_write(const char* data, uint8_t length) {
+	uint8_t written = buffer_bytes(data, length, 0);
+	serial_bytes_dropped += length - written;
+	return written;
+}
+
+uint8_t serial_try_write_P(const char* data, uint8_t length) {
+	uint8_t written = buffer_bytes(data, length, 1);
+	serial_bytes_dropped += length - written;
+	return written;
+}
+
+/*
+** Copy as many of the given bytes as there is space for into the
+** output buffer and return the number copied. The bytes are published
+** to the ISR with a single update of out_head.
+*/
+static uint8_t buffer_bytes(const char* data, uint8_t length, 
+		uint8_t fromProgmem) {
+	uint8_t head;
+	uint8_t i;
+
+	head = out_head;
+	if(length > OUTPUT_BUFFER_SIZE - (uint8_t)(head - out_tail)) {
+		length = OUTPUT_BUFFER_SIZE - (uint8_t)(head - out_tail);
+	}
+	for(i = 0; i < length; i++) {
+		out_buffer[(uint8_t)(head + i) & (OUTPUT_BUFFER_SIZE - 1)] = 
+				fromProgmem ? pgm_read_byte(data + i) : data[i];
+	}
+	if(length) {
+		out_head = head + length;
+		hal_uart_tx_interrupt(1);
+	}
+	return length;
+}
+
+/*
+** Copy all the given bytes into the output buffer, waiting for the
+** ISR to make space if necessary.
+*/
+static void write_bytes(const char* data, uint8_t length, 
+		uint8_t fromProgmem) {
+	uint8_t written;
+
+	written = buffer_bytes(data, length, fromProgmem);
+	if(written < length) {
+		serial_bytes_deferred += length - written;
+		do {
+			data += written;
+			length -= written;
+			written = buffer_bytes(data, length, fromProgmem);
+		} while(written < length);
+	}
 }
 
 /*
- * Define the interrupt handler for UART Data Register Empty (i.e. 
- * another character can be taken from our buffer and written out)
+ * Interrupt handler for UART Data Register Empty (i.e. another 
+ * character can be taken from our buffer and written out) - called
+ * by the HAL.
  */
 
-ISR(UART_UDRE_vect) 
+void serial_tx_ready(void)
 {
+	uint8_t tail = out_tail;
+
 	/* Check if we have data in our buffer */
-	if(bytes_in_out_buffer > 0) {
-		/* Yes we do - remove the pending byte and output it
-		** via the UART. The pending byte (character) is the
-		** one which is "bytes_in_buffer" characters before the 
-		** insert_pos (taking into account that we may 
-		** need to wrap around to the end of the buffer).
-		*/
-		char c;
-		if(out_insert_pos - bytes_in_out_buffer < 0) {
-			/* Need to wrap around */
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer
-				+ OUTPUT_BUFFER_SIZE];
-		} else {
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer];
-		}
-		/* Decrement our count of the number of bytes in the 
-		** buffer 
+	if(out_head != tail) {
+		/* Yes we do - output the oldest character via the UART 
+		** and advance out_tail past it.
 		*/
-		bytes_in_out_buffer--;
-		
-		/* Output the character via the UART */
-		UDR = c;
+		hal_uart_put(out_buffer[tail & (OUTPUT_BUFFER_SIZE - 1)]);
+		out_tail = tail + 1;
 	} else {
 		/* No data in the buffer. We disable the UART Data
 		** Register Empty interrupt because otherwise it 
@@ -231,32 +255,26 @@ ISR(UART_UDRE_vect)
 		** The interrupt is reenabled when a character is
 		** placed in the buffer
 		*/
-		UCR &= ~(1<<UDRIE);
+		hal_uart_tx_interrupt(0);
 	}
 }
 
 /*
- * Define the interrupt handler for UART Receive Complete (i.e. 
- * we can read a character. The character is read and placed in
- * the input buffer. 
- *
- * NOTE: We ignore the possibility of hardware input overrun, i.e. a new
- * character arriving before the old one is read from the UDR I/O register.
+ * Interrupt handler for UART Receive Complete - called by the HAL 
+ * with the character received, which is placed in the input buffer.
  */
 
-ISR(UART_RX_vect) 
+void serial_received(char c)
 {
-	/* Read the character */
-	char c;
-	c = UDR;
+	uint8_t head = input_head;
 		
-	if(do_echo && bytes_in_out_buffer < OUTPUT_BUFFER_SIZE) {
-		/* If echoing is enabled and there is output buffer
-		** space, echo the received character back to the UART.
-		** (If there is no output buffer space, characters
-		** will be lost.)
+	if(do_echo && out_head == out_tail && hal_uart_tx_empty()) {
+		/* If echoing is enabled and nothing else is waiting to
+		** be output, echo the received character straight back
+		** to the UART. (Only the main program may add to the 
+		** output buffer, so otherwise the character is not echoed.)
 		*/
-		uart_put_char(c, 0);
+		hal_uart_put(c);
 	}
 	
 	/* 
@@ -265,7 +283,7 @@ ISR(UART_RX_vect)
 	** overrun flag - it's up to the programmer to check/clear
 	** this flag if desired.)
 	*/
-	if(bytes_in_input_buffer >= INPUT_BUFFER_SIZE) {
+	if((uint8_t)(head - input_tail) >= INPUT_BUFFER_SIZE) {
 		input_overrun = 1;
 	} else {
 		/* If the character is a carriage return, turn it into a
@@ -278,11 +296,7 @@ ISR(UART_RX_vect)
 		/* 
 		** There is room in the input buffer 
 		*/
-		input_buffer[input_insert_pos++] = c;
-		bytes_in_input_buffer++;
-		if(input_insert_pos == INPUT_BUFFER_SIZE) {
-			/* Wrap around buffer pointer if necessary */
-			input_insert_pos = 0;
-		}
+		input_buffer[head & (INPUT_BUFFER_SIZE - 1)] = c;
+		input_head = head + 1;
 	}
 }
@@ -3,9 +3,10 @@
  *
  * Written by Peter Sutton.
  * 
- * Module to allow standard input/output routines to be used via 
- * serial port. The init_serial_stdio() method must be called before
- * any standard IO methods (e.g. printf). We use interrupt-based serial
+ * Module to do input/output via the serial port. The
+ * init_serial_stdio() method must be called before any of the other
+ * methods. (Despite its name it doesn't set up the stdio streams -
+ * see serialio.c.) We use interrupt-based serial
  * IO and a circular buffer to store output messages. (This allows us 
  * to print many characters at once to the buffer and have them 
  * output by the UART as speed permits.) Interrupts must be enabled 
@@ -17,6 +18,22 @@
 #ifndef SERIALIO_H
 #define SERIALIO_H
 
+#include <inttypes.h>
+
+/*
+** Sizes of the output and input circular buffers. These can be 
+** overridden at compile time (e.g. -DOUTPUT_BUFFER_SIZE=128) but
+** must be powers of 2 no greater than 128. The main loop reads keys
+** as they arrive, so the input buffer only needs room for one arrow
+** key (a 3 character escape sequence) and one more key.
+*/
+#ifndef OUTPUT_BUFFER_SIZE
+#define OUTPUT_BUFFER_SIZE 32
+#endif
+#ifndef INPUT_BUFFER_SIZE
+#define INPUT_BUFFER_SIZE 4
+#endif
+
 /*
 ** Initialise serial IO using the UART. baudrate specifies the desired
 ** baudrate (e.g. 19200) and echo determines whether incoming characters
@@ -31,4 +48,41 @@ void init_serial_stdio(long baudrate, char echo);
 */
 int8_t input_available(void);
 
+/*
+** Character output and input. serial_put_char() writes a character
+** (a \n is written as \r\n), waiting for space in the buffer if it
+** is full. serial_puts_P() writes a string in program memory (e.g.
+** PSTR()) in the same way. serial_get_char() waits for a character
+** to be received and returns it (a \r is received as \n).
+*/
+void serial_put_char(char c);
+void serial_puts_P(const char* string);
+char serial_get_char(void);
+
+/*
+** Bulk output. These copy a whole span of bytes into the output
+** buffer at once (with no \n to \r\n translation).
+** The _P versions take a string in program memory (e.g. PSTR()).
+**
+** serial_write() waits for space if the buffer fills up. The number of
+** bytes that could not be buffered straight away (and so had to wait)
+** is added to serial_bytes_deferred.
+**
+** serial_try_write() never waits. It buffers as many bytes as there is
+** space for and returns that number. The number of bytes that were not
+** buffered is added to serial_bytes_dropped.
+**
+** serial_space() returns the number of bytes that can currently be
+** written without waiting. Code that must not wait (e.g. the game loop)
+** can use it to check that a whole message will fit before writing it.
+*/
+void serial_write(const char* data, uint8_t length);
+void serial_write_P(const char* data, uint8_t length);
+uint8_t serial_try_write(const char* data, uint8_t length);
+uint8_t serial_try_write_P(const char* data, uint8_t length);
+uint8_t serial_space(void);
+
+extern uint16_t serial_bytes_deferred;
+extern uint16_t serial_bytes_dropped;
+
 #endif
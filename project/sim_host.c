@@ -0,0 +1,205 @@
+/*
+** sim_host.c
+**
+** Headless simulation of the game on a Linux host. A simple computer
+** player plays game after game, stepping the game core (see game.h)
+** with nothing drawn, and the speed and the results of the games are
+** reported. The game periods can be given, to try out other game
+** configurations. With -r, the first game is recorded (see record.h)
+** and written to the given file, to be replayed with snake_replay.
+**
+** Usage: snake_sim [-r file] [ticks] [seed] [move period] [rat period]
+**		[wall period]
+** (The periods are in ticks - the defaults are those of the game. The
+** games are seeded with seed, seed + 1, ...)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hal.h"
+#include "game.h"
+#include "board.h"
+#include "snake.h"
+#include "wall.h"
+#include "score.h"
+#include "eeprom_queue.h"
+#include "record.h"
+#include "serialio.h"
+
+/* The player's random number generator (xorshift - separate from the
+** game's)
+*/
+static uint32_t playerRandom;
+
+/* external variables */
+extern int8_t nextSnakeDirn;
+
+static uint32_t player_rand(void) {
+	playerRandom ^= playerRandom << 13;
+	playerRandom ^= playerRandom >> 17;
+	playerRandom ^= playerRandom << 5;
+	return playerRandom;
+}
+
+/* Choose the input for the next tick. Just before each move the
+** player turns in a random direction that keeps the snake on the
+** board and out of the walls (if there is one). Going straight on
+** needs no input.
+*/
+static int8_t choose_input(const GameState* state) {
+	PosnType head;
+	int8_t x;
+	int8_t y;
+	uint8_t start;
+	uint8_t i;
+	int8_t dirn;
+
+	if(state->moveCountdown != 1) {
+		return GAME_NO_INPUT;
+	}
+	head = get_snake_head_position();
+	start = player_rand() & 3;
+	for(i = 0; i < 4; i++) {
+		dirn = (start + i) & 3;
+		x = x_position(head);
+		y = y_position(head);
+		switch(dirn) {
+			case UP: y++; break;
+			case RIGHT: x++; break;
+			case DOWN: y--; break;
+			case LEFT: x--; break;
+		}
+		if(!is_off_board(x, y) && !is_wall_at(position(x, y))) {
+			return dirn == nextSnakeDirn ? GAME_NO_INPUT : dirn;
+		}
+	}
+	return GAME_NO_INPUT;
+}
+
+/* Write the recording (from EEPROM) to the named file, by sending it
+** to the UART as the board does. Returns 0 if it can't.
+*/
+static uint8_t write_recording(const char* name) {
+	FILE* file = fopen(name, "w");
+
+	if(!file) {
+		perror(name);
+		return 0;
+	}
+	hal_host_uart_output(file);
+	dump_recording();
+	hal_host_uart_output(NULL);
+	fclose(file);
+	return 1;
+}
+
+int main(int argc, char* argv[]) {
+	const char* recordName = NULL;
+	uint32_t ticks;
+	uint32_t seed;
+	GameState game;
+	RecordingType recording;
+	RandomType rng;
+	uint32_t t;
+	int8_t result;
+	uint32_t moves = 0;
+	uint32_t foodEaten = 0;
+	uint32_t ratsEaten = 0;
+	uint32_t games = 0;
+	uint32_t totalScore = 0;
+	uint16_t bestScore = 0;
+	struct timespec start;
+	struct timespec end;
+	double seconds;
+
+	if(argc > 2 && strcmp(argv[1], "-r") == 0) {
+		recordName = argv[2];
+		argv += 2;
+		argc -= 2;
+	}
+	ticks = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000000;
+	seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+
+	hal_host_init(NULL, NULL);
+	init_eeprom_queue();
+	init_serial_stdio(19200, 0);
+	init_score();
+	/* The recording is written through the EEPROM queue, which is
+	** driven by the (host's) interrupts */
+	hal_interrupts_on();
+
+	game_configure(&game);
+	if(argc > 3) {
+		game.movePeriod = strtoul(argv[3], NULL, 0);
+	}
+	if(argc > 4) {
+		game.ratPeriod = strtoul(argv[4], NULL, 0);
+	}
+	if(argc > 5) {
+		game.wallPeriod = strtoul(argv[5], NULL, 0);
+	}
+	if(!game.movePeriod || !game.ratPeriod || !game.wallPeriod) {
+		fprintf(stderr, "Periods must be at least 1 tick\n");
+		return 1;
+	}
+
+	playerRandom = seed * 2654435761u | 1;
+	if(recordName) {
+		game.recording = &recording;
+	}
+	game_new(&game, &rng, seed);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(t = 0; t < ticks; t++) {
+		result = game_step(&game, choose_input(&game), &rng);
+		if(result == 0) {
+			continue;
+		}
+		moves++;
+		if(result == ATE_FOOD) {
+			foodEaten++;
+		} else if(result == ATE_RAT) {
+			ratsEaten++;
+		} else if(result < 0) {
+			games++;
+			totalScore += get_score();
+			if(get_score() > bestScore) {
+				bestScore = get_score();
+			}
+			if(game.recording) {
+				/* Only the first game is recorded */
+				if(!write_recording(recordName)) {
+					return 1;
+				}
+				game.recording = NULL;
+			}
+			game_new(&game, &rng, seed + games);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if(game.recording) {
+		/* The first game didn't finish */
+		record_end(&recording, game.tick);
+		if(!write_recording(recordName)) {
+			return 1;
+		}
+	}
+	seconds = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("Periods (ticks): move %u, rats %u, walls %u\n",
+			game.movePeriod, game.ratPeriod, game.wallPeriod);
+	printf("%lu ticks in %.3fs - %.1f million ticks/s (%.1f ns/tick)\n",
+			(unsigned long)ticks, seconds, ticks / seconds / 1e6,
+			seconds * 1e9 / ticks);
+	printf("%lu moves - %.1f ns/move\n", (unsigned long)moves,
+			moves ? seconds * 1e9 / moves : 0.0);
+	printf("%lu games finished, mean score %.1f, best %u\n",
+			(unsigned long)games, games ? (double)totalScore / games : 0.0,
+			bestScore);
+	printf("%lu food and %lu rats eaten\n", (unsigned long)foodEaten,
+			(unsigned long)ratsEaten);
+	return 0;
+}
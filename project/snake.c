@@ -16,26 +16,26 @@
 #include "led_display.h"
 #include "terminalio.h"
 #include <stdio.h>
-#include <avr/pgmspace.h>
+#include "hal.h"
 #include "timer.h"
 //
 
 /* Global variables */
-/* We store the snake in a circular buffer - an array which can 
-** wrap around from the end to the start. The array is of size
-** MAX_SNAKE_SIZE, which is the maximum length of the snake.
+/* We store the snake as the positions of its head and tail, and the
+** direction of each step from the tail to the head - 2 bits each,
+** packed 4 to a byte. The steps are kept in a circular buffer of
+** SNAKE_STEPS steps (a snake of MAX_SNAKE_SIZE segments has one less
+** step than segments). snakeTailStep is the index of the step from
+** the tail - the steps of a snake of length n are at indexes
+** snakeTailStep to snakeTailStep+n-2 (wrapping around).
 */
-PosnType snakePositions[MAX_SNAKE_SIZE];
-
-/* Index values in the array of the head and tail positions of the snake.
-** The head position is to the right of the tail position (until the head
-** wraps around).
-** (The length of the snake is (head index - tail index + 1) and if
-** this result is 0 or negative then add 32.) 
-** (The index values are in the range of 0 to MAX_SNAKE_SIZE-1 inclusive.)
-*/
-int8_t snakeHeadIndex;
-int8_t snakeTailIndex;
+#define SNAKE_STEPS (MAX_SNAKE_SIZE - 1)
+
+uint8_t snakeSteps[(SNAKE_STEPS + 3) / 4];
+PosnType snakeHead;
+PosnType snakeTail;
+uint8_t snakeLength;
+uint8_t snakeTailStep;
 
 /*
 ** Variable to keep track of the current direction 
@@ -54,6 +54,11 @@ int8_t curSnakeDirn;
 int8_t nextSnakeDirn;
 
 
+/* Functions available within this file */
+static int8_t get_step(uint8_t index);
+static void set_step(uint8_t index, int8_t dirn);
+static void pop_tail(void);
+
 /* FUNCTIONS */
 /* init_snake()
 **
@@ -61,19 +66,14 @@ int8_t nextSnakeDirn;
 */
 void init_snake(void) {
 	/* Snake starts at (0,0) and finishes at (0,2) and
-	** has an initial length of 3. These positions will
-	** be stored at indexes 0, 1 and 2 in the array.
+	** has an initial length of 3 - two steps UP.
 	*/
-	snakeTailIndex = 0;
-	snakeHeadIndex = 2;
-	snakePositions[0] = 0x00;
-	snakePositions[1] = 0x01;
-	snakePositions[2] = 0x02;
+	set_snake_tail(0x00);
+	extend_snake(UP);
+	extend_snake(UP);
 	curSnakeDirn = UP;
     nextSnakeDirn = UP;
-	add_snake_element_to_board(0x00);
-	add_snake_element_to_board(0x01);
-	add_snake_element_to_board(0x02);
+	show_snake();
 }
 
 /* get_snake_head_position()
@@ -81,7 +81,7 @@ void init_snake(void) {
 ** Returns the position of the head of the snake. 
 */
 PosnType get_snake_head_position(void) {
-    return snakePositions[snakeHeadIndex];
+    return snakeHead;
 }
 
 /* get_snake_length()
@@ -89,15 +89,7 @@ PosnType get_snake_head_position(void) {
 ** Returns the length of the snake.
 */
 int8_t get_snake_length(void) {
-	int8_t len;
-	/* (The length of the snake is (head index - tail index + 1) and if
-	** this result is 0 or negative then add 32.) 
-	*/
-	len = snakeHeadIndex - snakeTailIndex + 1;
-	if (len <= 0) {
-		len += MAX_SNAKE_SIZE; //17Oct
-	}
-	return len;
+	return snakeLength;
 }
 
 /* 
@@ -108,18 +100,21 @@ int8_t get_snake_length(void) {
 **		edge, -2 (COLLISION) if the snake has run into itself,
 **      1 (MOVE_OK) if the move is successful, 2 (ATE_FOOD)
 **		if the snake has eaten
-**      some food (and grown). (The snake will only grow if
+**      some food (and grown), 3 (ATE_RAT) if it was a rat. 
+**		(The snake will only grow if
 ** 		there is room for it to do so in the array.).
 */
-int8_t move_snake(void) {
+int8_t move_snake(RandomType* rng) {
     int8_t foodAtHead;	/* True if food at new head position */
+	int8_t grow;	/* True if the snake should grow this move */
 	int8_t headX;	/* head X position */
 	int8_t headY;	/* head Y position */
 	PosnType headPosn;
+	uint8_t wallRoom;	/* wall segments that can still be added */
     
 	/* Current head position */
-	headX = (snakePositions[snakeHeadIndex] >> 4) & 0x07;
-	headY = snakePositions[snakeHeadIndex] & 0x0F;
+	headX = (snakeHead >> 4) & 0x07;
+	headY = snakeHead & 0x0F;
     
     /* Work out where the new head position should be - we
     ** move 1 position in our NEXT direction of movement.
@@ -149,8 +144,7 @@ int8_t move_snake(void) {
 	** not continue. See board.h for a function which can help you.
 	*/
 	
-	if(is_off_board((get_snake_head_position() >> 4) & 0x07, 
-				    get_snake_head_position() & 0x0F))
+	if(is_off_board(headX, headY))
 		return OUT_OF_BOUNDS;
 
 
@@ -169,26 +163,26 @@ int8_t move_snake(void) {
 	** Instead of returning COLLISION, cut the tail at the
 	** point of collision and save it as a wall
 	*/
-	int8_t c_index;
-	c_index = is_snake_at(headPosn);
-	if(c_index){
-		uint8_t start;
-		uint8_t stop;
-		extern int8_t wallInsertionIndex;
-		//store the start of the wall
-		start = wallInsertionIndex;
-
-		//copy from snake to collision point to wall array
-		//while trimming the snake along the way
-		while(snakeTailIndex < c_index){
-			add_wall_at(snakePositions[snakeTailIndex++]);
+	if(is_snake_at(headPosn)){
+		//move the segments from the tail to the collision point
+		//to the wall array, trimming the snake along the way.
+		//Each step from the tail finds the next segment, so there
+		//is no search for the collision point. The cells move
+		//straight from the snake layer to the wall layer, as far
+		//as there is room for them.
+		wallRoom = wall_space();
+		while(snakeTail != headPosn){
+			if(wallRoom){
+				move_occupied(SNAKE_LAYER, WALL_LAYER, snakeTail);
+				store_wall_segment(snakeTail);
+				wallRoom--;
+			}
+			else
+				clear_occupied(SNAKE_LAYER, snakeTail);
+			pop_tail();
 		}
-		//store the end of the wall
-		stop = wallInsertionIndex - start;
-		start = 0;
-		
 		//we just built a wall so flag it for deletion
-		flag_wall(position(start, stop));
+		flag_wall();
 
 	}
 	//*/
@@ -209,36 +203,26 @@ int8_t move_snake(void) {
     ** be the food ID
     */
     foodAtHead = food_at(headPosn);
+
+	/* The snake grows (keeps its tail) if it eats, unless
+	** it has reached its maximum size
+	*/
+	grow = (foodAtHead != -1 && get_snake_length() < MAX_SNAKE_SIZE);
     
     /*
     ** If we get here, the move should be possible.
-    ** Advance head by 1. First work out the index
-	** of the new head position in the array.
+    ** Advance the tail first (if the snake isn't growing) so
+    ** there is room in the array for the new step at the head.
     */
-	snakeHeadIndex++;
-	if(snakeHeadIndex == MAX_SNAKE_SIZE) {
-		/* Array has wrapped around */
-		snakeHeadIndex = 0;
-	}
-	
-	/* Advance the tail position. Note that we've already
-	** updated the head index - but not stored the new head
-	** position there yet since if the snake is maximum size
-	** the new head position will go into the array where the 
-	** old tail position was.
-	*/ 
-	/* Remove tail position from the board */
-	remove_snake_element_from_board(snakePositions[snakeTailIndex]);
-	/* Update the tail index */
-	snakeTailIndex++;
-	if(snakeTailIndex == MAX_SNAKE_SIZE) {
-		/* Array has wrapped around */
-		snakeTailIndex = 0;
+	if(!grow) {
+		/* Remove tail position from the board */
+		clear_occupied(SNAKE_LAYER, snakeTail);
+		pop_tail();
 	}
 
-	/* Store the head position and display it */
-	snakePositions[snakeHeadIndex] = headPosn;
-	add_snake_element_to_board(snakePositions[snakeHeadIndex]);
+	/* Add the new head and mark it on the board */
+	extend_snake(curSnakeDirn);
+	set_occupied(SNAKE_LAYER, headPosn);
 
 	/* YOUR CODE HERE to (1) if the snake ate food and if so, to remove the 
 	** food, add a new item of food and return ATE_FOOD.
@@ -249,11 +233,11 @@ int8_t move_snake(void) {
 		printf_P(PSTR("foodID: %u"), foodAtHead );
 		wait_for(1000);
 		//*/
-		remove_food(foodAtHead);
-
-		//increase the length of the snake unless snake is 40 segments
-		if(get_snake_length() < 40)
-			--snakeTailIndex;
+		if(is_occupied(RAT_LAYER, headPosn)) {
+			remove_food(foodAtHead, rng);
+			return ATE_RAT;
+		}
+		remove_food(foodAtHead, rng);
 
 		return ATE_FOOD;
 	}
@@ -309,55 +293,100 @@ int8_t set_snake_dirn(int8_t dirn) {
 }
 
 /* is_snake_at
-**		Check all snake positions and see if any part of the 
-**		snake is at the given position
+**		Check whether any part of the snake is at the given
+**		position - a single test of the snake occupancy layer
 */
-
 int8_t is_snake_at(PosnType position) {
-	int8_t index;
+	return is_occupied(SNAKE_LAYER, position);
+}
 
-	/* Start at tail and work forward to the head.
-	*/
-	index = snakeTailIndex;
-	while(index != snakeHeadIndex) {
-		if(position == snakePositions[index]) {
-			//return 1;
-			//4209435
-			return index;
-		}
-		index++;
-		if(index == MAX_SNAKE_SIZE) { //19 Oct
-			index = 0;
-		} 
+//4209435
+void show_snake(void) {
+	SnakeIteratorType segment;
+
+	/* Walk from the tail to the head, marking each element */
+	first_snake_segment(&segment);
+	do {
+		set_occupied(SNAKE_LAYER, segment.posn);
+	} while(next_snake_segment(&segment));
+}
+
+void first_snake_segment(SnakeIteratorType* segment) {
+	segment->posn = snakeTail;
+	segment->dirn = curSnakeDirn;
+	segment->step = snakeTailStep;
+	segment->remaining = snakeLength - 1;
+}
+
+uint8_t next_snake_segment(SnakeIteratorType* segment) {
+	if(segment->remaining == 0) {
+		return 0;
 	}
-	/* Now check head position, since it is not checked above. */
-	if(position == snakePositions[snakeHeadIndex]) {
-		return 1;
+	segment->dirn = get_step(segment->step);
+	segment->posn = step_position(segment->posn, segment->dirn);
+	if(++segment->step == SNAKE_STEPS) {
+		segment->step = 0;
 	}
-	/* Snake does not occupy the given position */
-	return 0;
+	segment->remaining--;
+	return 1;
 }
 
-//4209435
-void show_snake(void) {
-	int8_t i;
+void set_snake_tail(PosnType posn) {
+	snakeHead = posn;
+	snakeTail = posn;
+	snakeLength = 1;
+	snakeTailStep = 0;
+}
 
-	//hack to fix a jump by one after pausing
-	snakeHeadIndex--;
-	snakeTailIndex--;
+void extend_snake(int8_t dirn) {
+	uint8_t index;
+	/* The new step goes after the last one */
+	index = snakeTailStep + snakeLength - 1;
+	if(index >= SNAKE_STEPS) {
+		index -= SNAKE_STEPS;
+	}
+	set_step(index, dirn);
+	snakeHead = step_position(snakeHead, dirn);
+	snakeLength++;
+}
 
-	for(i=0; i < MAX_SNAKE_SIZE; i++) {
+/* A position is x << 4 | y, so a step is a single add. A step off the
+** board borrows from (or carries into) x, but still gives a position
+** that is off the board - y becomes 15, or x becomes 7 (bit 7 is
+** ignored, as it marks rats).
+*/
+#if BOARD_WIDTH > 7 || BOARD_ROWS > 15
+#error "step_position() needs the board to be at most 7 x 15"
+#endif
+
+PosnType step_position(PosnType posn, int8_t dirn) {
+	switch(dirn) {
+		case UP:
+			return posn + 0x01;
+		case RIGHT:
+			return posn + 0x10;
+		case DOWN:
+			return posn - 0x01;
+		default:
+			return posn - 0x10;
+	}
+}
 
-		//only do it for visible elements
-		//snake hasn't wrapped around
-		if(snakeHeadIndex > snakeTailIndex) {
-			if( i <= snakeHeadIndex && i >= snakeTailIndex)
-				add_snake_element_to_board(snakePositions[i]);
-		}
-		//snake has wrapped around
-		else {
-			if( i <= snakeHeadIndex || i >= snakeTailIndex)
-				add_snake_element_to_board(snakePositions[i]);
-		}
+/* Move the tail one step towards the head */
+static void pop_tail(void) {
+	snakeTail = step_position(snakeTail, get_step(snakeTailStep));
+	if(++snakeTailStep == SNAKE_STEPS) {
+		snakeTailStep = 0;
 	}
+	snakeLength--;
+}
+
+/* Get/set the direction of the step at the given index */
+static int8_t get_step(uint8_t index) {
+	return (snakeSteps[index >> 2] >> ((index & 0x03) << 1)) & 0x03;
+}
+
+static void set_step(uint8_t index, int8_t dirn) {
+	uint8_t shift = (index & 0x03) << 1;
+	snakeSteps[index >> 2] = (snakeSteps[index >> 2] & ~(0x03 << shift)) | (dirn << shift);
 }
@@ -12,8 +12,10 @@
 
 #include <inttypes.h>
 #include "position.h"
+#include "board.h"
 
-#define MAX_SNAKE_SIZE 40
+/* The snake can fill the whole board */
+#define MAX_SNAKE_SIZE (BOARD_ROWS * BOARD_WIDTH)
 
 /* Directions */
 #define UP 0
@@ -26,6 +28,7 @@
 #define COLLISION -2
 #define MOVE_OK 1
 #define ATE_FOOD 2
+#define ATE_RAT 3
 
 /* init_snake()
 **
@@ -54,11 +57,13 @@ int8_t get_snake_length(void);
 ** Returns -1 (OUT_OF_BOUNDS) if the snake has run into the 
 ** edge, -2 (COLLISION) if the snake has run into itself,
 ** 1 (MOVE_OK) if the move is successful, 2 (ATE_FOOD)
-** if the snake has eaten some food (and grown). 
+** if the snake has eaten some food (and grown), 3 (ATE_RAT)
+** if the food was a rat. 
 ** (The snake will only grow if there is room for it to 
-** do so in the array.).
+** do so in the array.). The given random number generator
+** places the food that replaces any eaten.
 */
-int8_t move_snake(void);
+int8_t move_snake(RandomType* rng);
 
 /* set_snake_dirn(direction)
 **
@@ -79,6 +84,44 @@ int8_t set_snake_dirn(int8_t dirn);
 */
 int8_t is_snake_at(PosnType position);
 
+/* Segment iterator. Visits each segment of the snake from the
+** tail to the head:
+**	SnakeIteratorType segment;
+**	first_snake_segment(&segment);
+**	do {
+**		... segment.posn ...
+**	} while(next_snake_segment(&segment));
+** next_snake_segment() returns 0 (and doesn't move) if the
+** current segment is the head. segment.dirn is the direction of
+** the step from the previous segment to this one. The snake must
+** not be moved while it is being iterated over.
+*/
+typedef struct {
+	PosnType posn;		/* the current segment */
+	int8_t dirn;		/* direction of the step to this segment */
+	uint8_t step;		/* index of the step to the next segment */
+	uint8_t remaining;	/* number of segments after this one */
+} SnakeIteratorType;
+
+void first_snake_segment(SnakeIteratorType* segment);
+uint8_t next_snake_segment(SnakeIteratorType* segment);
+
+/* Rebuild the snake (e.g. from a saved game): set_snake_tail()
+** makes the snake a single segment at the given position, and
+** extend_snake() adds a new head one step from the current head
+** in the given direction. Neither marks the snake on the board
+** (see show_snake()) or checks the move is possible.
+*/
+void set_snake_tail(PosnType posn);
+void extend_snake(int8_t dirn);
+
+/* step_position(position, direction)
+**
+** Returns the position one step from the given one in the given
+** direction. (It may be off the board.)
+*/
+PosnType step_position(PosnType posn, int8_t dirn);
+
 /* is_body_at(position)
 **
 ** Returns 1 if the given position is occupied by 
@@ -88,7 +131,8 @@ int8_t is_body_at(PosnType position);
 
 /* 42094353 show_snake(void)
 **
-** Display the snake on the board
+** Mark the snake on the snake occupancy layer (which
+** is shown on the display)
 */
 void show_snake(void);
 
@@ -4,31 +4,125 @@
  * Written by Justin Mancinelli
  */
 
-#include <avr/io.h>
+#include "hal.h"
+#include "sound.h"
 #include "timer.h"
 #include "terminalio.h"
-#include <avr/pgmspace.h>
-#include <stdio.h>
+#include "serialio.h"
 
+/* The output toggles every OCR1A+1 clock cycles (see hal_tone()), so
+ * a note of frequency f needs OCR1A = 4MHz / (2 * f) - 1.
+ */
+#define NOTE(f) ((uint16_t)(2000000UL / (f) - 1))
+#define REST 0
+
+/* A note is played for duration ms (which should be even, see 
+ * timer.h). A REST is a note with no tone, and a duration of 0 
+ * ends the melody.
+ */
+typedef struct {
+	uint16_t ocr;
+	uint16_t duration;
+} NoteType;
+
+static const NoteType eatMelody[] PROGMEM = {
+	{NOTE(659), 60}, {NOTE(784), 60}, {NOTE(1047), 120}, {REST, 0}
+};
+
+static const NoteType ratMelody[] PROGMEM = {
+	{NOTE(1047), 50}, {REST, 30}, {NOTE(1047), 50}, {REST, 30},
+	{NOTE(1568), 120}, {REST, 0}
+};
+
+static const NoteType gameOverMelody[] PROGMEM = {
+	{NOTE(784), 150}, {NOTE(659), 150}, {NOTE(523), 150}, 
+	{NOTE(392), 400}, {REST, 0}
+};
+
+/* Indexed by the MELODY_ numbers in sound.h */
+static const NoteType* const melodies[] PROGMEM = {
+	eatMelody, ratMelody, gameOverMelody
+};
+
+/* The next note to play, and the software timer that will play it
+ * (0 if none). These are only changed from non-ISR code with 
+ * interrupts off. soundTimerNum is cleared as soon as its timer
+ * expires or is cancelled - the timer may then be given to someone
+ * else, so the sound must never cancel it again.
+ */
+static const NoteType* volatile nextNote;
+static volatile uint8_t soundTimerNum;
+
+static void play_next_note(void);
 
 int8_t soundStatus = 1;
 
 void init_sound(void){
-	DDRD = (1<<DDD5) | (1<<DDD4);
-	PORTD = 0;
-	TCCR1A = 0x40;
-	OCR1A = 1999;
-	TCCR1B = 0x08;
+	hal_sound_init();
 }
 
-void play_sound(void){
-	TCCR1B |= 0x01;
-	wait_for(300);
-	TCCR1B &= 0xFE;
+void play_melody(uint8_t melody){
+	uint8_t interrupts_on;
+
+	if(!soundStatus){
+		return;
+	}
+	interrupts_on = hal_interrupts_off();
+	if(soundTimerNum){
+		cancel_software_timer(soundTimerNum);
+		soundTimerNum = 0;
+	}
+	nextNote = (const NoteType*)pgm_read_ptr(&melodies[melody]);
+	play_next_note();
+	hal_interrupts_restore(interrupts_on);
+}
+
+void stop_sound(void){
+	uint8_t interrupts_on = hal_interrupts_off();
+	if(soundTimerNum){
+		cancel_software_timer(soundTimerNum);
+		soundTimerNum = 0;
+	}
+	hal_tone_off();
+	hal_interrupts_restore(interrupts_on);
+}
+
+/* Start the next note and set a timer to play the one after it when
+ * this one is done. Called from play_melody() and then from the timer 
+ * ISR, so it only touches the tone output and the melody position.
+ */
+static void play_next_note(void){
+	uint16_t ocr;
+	uint16_t duration;
+
+	soundTimerNum = 0;
+	duration = pgm_read_word(&nextNote->duration);
+	if(duration == 0){
+		/* End of the melody */
+		hal_tone_off();
+		return;
+	}
+	ocr = pgm_read_word(&nextNote->ocr);
+	if(ocr == REST){
+		hal_tone_off();
+	}
+	else{
+		hal_tone(ocr);
+	}
+	nextNote++;
+
+	soundTimerNum = execute_function_once_after_delay(duration, play_next_note);
+	if(!soundTimerNum){
+		/* No free software timer - stop rather than drone on */
+		hal_tone_off();
+	}
 }
 
 void toggle_sound(void){
 	soundStatus = !soundStatus;
+	if(!soundStatus){
+		stop_sound();
+	}
 }
 
 int8_t sound_status(void){
@@ -38,9 +132,9 @@ int8_t sound_status(void){
 void display_sound_status(void){
 	move_cursor(1,3);
 	if(soundStatus){
-		printf_P(PSTR("Sound: On "));
+		serial_puts_P(PSTR("Sound: On "));
 	}
 	else{
-		printf_P(PSTR("Sound: Off"));
+		serial_puts_P(PSTR("Sound: Off"));
 	}
 }
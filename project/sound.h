@@ -7,11 +7,26 @@
  
 /* Guard band to ensure this definition is only included once */
 #ifndef SOUND_H
-#define SSOUND_H
+#define SOUND_H
+
+#include <inttypes.h>
+
+/* Melodies that can be played by play_melody() */
+#define MELODY_EAT 0
+#define MELODY_RAT 1
+#define MELODY_GAME_OVER 2
 
 void init_sound(void);
 
-void play_sound(void);
+/* Start playing the given melody (if sound is on), replacing any
+ * melody that is playing. Returns straight away - the notes are
+ * played by a software timer callback, which only changes the
+ * Timer1 registers, so the game carries on while they play.
+ */
+void play_melody(uint8_t melody);
+
+/* Stop any melody that is playing */
+void stop_sound(void);
 
 void toggle_sound(void);
 
@@ -5,30 +5,115 @@
 */
 
 #include <stdio.h>
-#include <avr/pgmspace.h>
+#include "hal.h"
+#include "terminalio.h"
+#include "serialio.h"
+
+/* Escape sequences are written straight to the serial output buffer
+** rather than going through printf - see terminalio.h
+*/
+static const char normalDisplayMode[] PROGMEM = "\x1b[0m";
+static const char reverseVideo[] PROGMEM = "\x1b[7m";
+static const char clearTerminal[] PROGMEM = "\x1b[2J";
+static const char clearToEndOfLine[] PROGMEM = "\x1b[K";
+static const char downAndLeft[] PROGMEM = "\x1b[B\x1b[D";
+
+/* Powers of ten used to convert numbers to decimal by repeated
+** subtraction (the AVR has no divide instruction)
+*/
+static const uint16_t powersOfTen[] PROGMEM = {10000, 1000, 100, 10};
+
+/* Write the decimal digits of value into buffer (which must have 
+** room for 5 characters) and return the number of digits.
+*/
+uint8_t format_unsigned(char* buffer, uint16_t value) {
+	uint8_t i;
+	uint8_t length;
+	uint16_t power;
+	char digit;
+
+	length = 0;
+	for(i = 0; i < 4; i++) {
+		power = pgm_read_word(&powersOfTen[i]);
+		digit = '0';
+		while(value >= power) {
+			value -= power;
+			digit++;
+		}
+		/* Skip leading zeros */
+		if(digit != '0' || length) {
+			buffer[length++] = digit;
+		}
+	}
+	buffer[length++] = '0' + value;
+	return length;
+}
+
+void print_unsigned(uint16_t value) {
+	char buffer[5];
+	serial_write(buffer, format_unsigned(buffer, value));
+}
+
+/* Write the escape sequence to move the cursor to (x,y) into buffer
+** and return its length. The longest sequence is ESC [ yyy ; xxx H 
+** so buffer must have room for 10 characters.
+*/
+static uint8_t format_cursor_move(char* buffer, int8_t x, int8_t y) {
+	uint8_t length;
+
+	buffer[0] = '\x1b';
+	buffer[1] = '[';
+	length = 2 + format_unsigned(buffer + 2, (uint8_t)y);
+	buffer[length++] = ';';
+	length += format_unsigned(buffer + length, (uint8_t)x);
+	buffer[length++] = 'H';
+	return length;
+}
 
 void move_cursor(int8_t x, int8_t y) {
-    printf_P(PSTR("\x1b[%d;%dH"), (int)y, (int)x);
+	char buffer[10];
+	serial_write(buffer, format_cursor_move(buffer, x, y));
+}
+
+uint8_t try_draw_text(int8_t x, int8_t y, const char* text, uint8_t length) {
+	char buffer[10];
+	uint8_t cursorLength;
+
+	cursorLength = format_cursor_move(buffer, x, y);
+	if(serial_space() < cursorLength + length) {
+		return 0;
+	}
+	serial_write(buffer, cursorLength);
+	serial_write(text, length);
+	return cursorLength + length;
 }
 
 void normal_display_mode(void) {
-	printf_P(PSTR("\x1b[0m"));
+	serial_write_P(normalDisplayMode, sizeof(normalDisplayMode) - 1);
 }
 
 void reverse_video(void) {
-	printf_P(PSTR("\x1b[7m"));
+	serial_write_P(reverseVideo, sizeof(reverseVideo) - 1);
 }
 
 void clear_terminal(void) {
-	printf_P(PSTR("\x1b[2J"));
+	serial_write_P(clearTerminal, sizeof(clearTerminal) - 1);
 }
 
 void clear_to_end_of_line(void) {
-	printf_P(PSTR("\x1b[K"));
+	serial_write_P(clearToEndOfLine, sizeof(clearToEndOfLine) - 1);
 }
 
 void set_display_attribute(int8_t parameter) {
-	printf_P(PSTR("\x1b[%dm"), (int)parameter);
+	/* ESC [ ppp m */
+	char buffer[6];
+	uint8_t length;
+
+	buffer[0] = '\x1b';
+	buffer[1] = '[';
+	length = 2 + format_unsigned(buffer + 2, (uint8_t)parameter);
+	buffer[length++] = 'm';
+	serial_write(buffer, length);
 }
 
 void draw_horizontal_line(int8_t y, int8_t startx, int8_t endx) {
@@ -36,10 +121,7 @@ void draw_horizontal_line(int8_t y, int8_t startx, int8_t endx) {
 	move_cursor(startx, y);
 	reverse_video();
 	for(i=startx; i <= endx; i++) {
-		printf(" ");	/* No need to use printf_P - printing 
-				** a single character gets optimised
-				** to a putchar call 
-				*/
+		serial_put_char(' ');
 	}
 	normal_display_mode();
 }
@@ -49,11 +131,11 @@ void draw_vertical_line(int8_t x, int8_t starty, int8_t endy) {
 	move_cursor(x, starty);
 	reverse_video();
 	for(i=starty; i < endy; i++) {
-		printf(" ");
+		serial_put_char(' ');
 		/* Move down one and back to the left one */
-		printf_P(PSTR("\x1b[B\x1b[D"));
+		serial_write_P(downAndLeft, sizeof(downAndLeft) - 1);
 	}
-	printf(" ");
+	serial_put_char(' ');
 	normal_display_mode();
 }
 
@@ -41,6 +41,27 @@ void clear_to_end_of_line(void);
 */
 void set_display_attribute(int8_t parameter);
 
+/*
+** Output value as an unsigned decimal number (at the cursor).
+** format_unsigned() instead writes the digits into buffer (which
+** must have room for 5) and returns the number of digits.
+**
+** These, and the functions above, write directly to the serial output
+** buffer and don't use printf. (avr-libc's vfprintf is large and slow,
+** and is not linked in at all if nothing calls the printf family. The
+** AVR build fails if it is linked.)
+*/
+void print_unsigned(uint16_t value);
+uint8_t format_unsigned(char* buffer, uint16_t value);
+
+/*
+** Move the cursor to (x,y) and output the given text (length 
+** characters), but only if the serial output buffer has room for
+** all of it, so this never waits. Returns the number of bytes
+** written (0 if there wasn't room).
+*/
+uint8_t try_draw_text(int8_t x, int8_t y, const char* text, uint8_t length);
+
 /*
 ** Draw a reverse video line on the terminal. startx must be <= endx.
 ** starty must be <= endy
@@ -0,0 +1,159 @@
+/*
+** test_host.c
+**
+** Checks, on a Linux host (see hal_host.h), that the game's software
+** timers are handed back correctly. The game timers and the sound
+** share the software timers, and each keeps the number of the timer
+** it started, so a number that is kept after its timer has been
+** cancelled (or has expired) can later cancel whoever has been given
+** that timer since. The main loop's sequence (see project.c) is
+** followed through a game over, a new game and eating food, checking
+** that every melody ends and every game tick still arrives.
+**
+** Usage: snake_test
+** The exit status is 0 if all the checks pass.
+*/
+
+#include <stdio.h>
+#include "hal.h"
+#include "game.h"
+#include "snake.h"
+#include "score.h"
+#include "sound.h"
+#include "timer.h"
+#include "events.h"
+#include "led_display.h"
+#include "eeprom_queue.h"
+#include "serialio.h"
+
+/* The longest melody (the game over one) lasts 850ms */
+#define MELODY_TICKS GAME_TICKS(1000)
+
+/* When run() stops */
+#define RUN_ALL 0
+#define UNTIL_GAME_OVER 1
+#define UNTIL_EATEN 2
+
+static GameState game;
+static RandomType rng;
+static uint8_t moveStarted;	/* true once the input for a move is given */
+static uint8_t failures;
+
+static void check(uint8_t ok, const char* what) {
+	if(!ok) {
+		fprintf(stderr, "FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+/* What handle_game_over() and then new_game() in project.c do (without
+** waiting for a key)
+*/
+static void game_over_then_new_game(void) {
+	stop_game_timers();
+	play_melody(MELODY_GAME_OVER);
+	stop_game_timers();
+	game_new(&game, &rng, 1);
+	moveStarted = 0;
+	start_game_timers();
+}
+
+/* Let ticks pass, stepping the game for each game tick as the main
+** loop does. At the start of each move the snake is turned by the
+** next character of moves (U, D, L or R - anything else carries
+** straight on) until they run out. Unless until is RUN_ALL, stops
+** early if the game is over (or, for UNTIL_EATEN, the snake eats
+** food or a rat). Game ticks after the game is over are taken but not
+** stepped. Returns the game ticks that were taken.
+*/
+static uint32_t run(uint32_t ticks, const char** moves, uint8_t until,
+		int8_t* status) {
+	uint32_t stepped = 0;
+	int8_t input;
+
+	*status = 0;
+	while(ticks--) {
+		hal_host_tick();
+		while(get_event() == EVENT_GAME_TICK) {
+			stepped++;
+			if(*status < 0) {
+				continue;
+			}
+			input = GAME_NO_INPUT;
+			if(!moveStarted && moves && **moves) {
+				switch(*(*moves)++) {
+					case 'U': input = UP; break;
+					case 'D': input = DOWN; break;
+					case 'L': input = LEFT; break;
+					case 'R': input = RIGHT; break;
+				}
+				moveStarted = 1;
+			}
+			*status = game_step(&game, input, &rng);
+			if(*status != 0) {
+				moveStarted = 0;
+			}
+			if(*status == ATE_FOOD) {
+				play_melody(MELODY_EAT);
+			} else if(*status == ATE_RAT) {
+				play_melody(MELODY_RAT);
+			}
+		}
+		if(until != RUN_ALL && (*status < 0 || (until == UNTIL_EATEN &&
+				(*status == ATE_FOOD || *status == ATE_RAT)))) {
+			break;
+		}
+	}
+	return stepped;
+}
+
+int main(void) {
+	const char* moves;
+	int8_t status;
+	uint32_t stepped;
+
+	hal_host_init(NULL, NULL);
+	init_timer();
+	init_events();
+	init_eeprom_queue();
+	init_score();
+	init_serial_stdio(19200, 0);
+	init_sound();
+	hal_interrupts_on();
+	init_display();
+	game_configure(&game);
+	game_new(&game, &rng, 1);
+	start_game_timers();
+
+	/* Run into the top of the board, and start a new game while the
+	** game over melody plays
+	*/
+	moves = "UUUUUUUUUUUUUUUUUU";
+	run(GAME_TICKS(30000), &moves, UNTIL_GAME_OVER, &status);
+	check(status < 0, "the first game ends");
+	game_over_then_new_game();
+	stepped = run(MELODY_TICKS, NULL, RUN_ALL, &status);
+	check(hal_host_tone() == 0, "the game over melody ends");
+	check(stepped == MELODY_TICKS, "the new game gets every game tick");
+
+	/* Again, then play snake_host's "RRRRUUUULLLLDDDD..........RRRR"
+	** game, which eats a rat
+	*/
+	moves = "UUUUUUUUUUUUUUUUUU";
+	run(GAME_TICKS(30000), &moves, UNTIL_GAME_OVER, &status);
+	check(status < 0, "the second game ends");
+	game_over_then_new_game();
+	moves = "RRRRUUUULLLLDDDD..........RRRR";
+	run(GAME_TICKS(30000), &moves, UNTIL_EATEN, &status);
+	check(status == ATE_FOOD || status == ATE_RAT, "the snake eats");
+	stepped = run(MELODY_TICKS, NULL, RUN_ALL, &status);
+	check(hal_host_tone() == 0, "the eat melody ends");
+	check(stepped == MELODY_TICKS,
+			"the game gets every game tick after eating");
+
+	if(failures) {
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
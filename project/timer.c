@@ -5,37 +5,55 @@
 */
 
 #include "timer.h"
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include "hal.h"
+
+#if NUM_SW_TIMERS > 8
+#error "sw_timer_once_only only has room for 8 timers"
+#endif
 
 /* Our global timer variable - counts in milliseconds. Will wrap 
 ** around after 65535
 */
 volatile uint16_t time;
 
-/* Software timer values, duration targets, functions to be
-** executed when the target is reached and flags to
-** indicate whether we do this once or repeatedly If the target
-** duration is non-zero, then the timer is active. (The
-** values, target and once only flag can be changed in 
-** the interrupt service routine so are labeled volatile.)
+/* Software timer durations (delay or period - if the target 
+** duration is non-zero, then the timer is active), deadlines (the
+** value of time at which the timer next expires), functions to be
+** executed when the deadline is reached and flags (a bit for each
+** timer) to indicate whether we do this once or repeatedly. Durations are rounded up to a
+** multiple of 2 so that time (which counts in 2s) reaches each 
+** deadline exactly. (The target and once only flag can be changed
+** in the interrupt service routine so are labeled volatile.) Timer
+** number n is kept at index n-1. (wait_for() watches the time rather
+** than taking a timer, so there is no timer 0.)
+*/
+uint16_t sw_timer_deadline[NUM_SW_TIMERS];
+volatile uint16_t sw_timer_target[NUM_SW_TIMERS];
+TimerFunctionType* sw_timer_functions[NUM_SW_TIMERS];
+volatile uint8_t sw_timer_once_only;
+
+/* The active timers are kept in a binary min-heap ordered by the time
+** remaining until their deadline (deadline - time, which stays in
+** order as time advances because expired timers are removed
+** straight away). The interrupt handler then only looks at the timers
+** which are due, however many timers are active. The heap holds timer
+** indexes, and must only be modified with interrupts off.
 */
-volatile uint16_t sw_timer_values[NUM_SW_TIMERS+1];
-volatile uint16_t sw_timer_target[NUM_SW_TIMERS+1];
-TimerFunctionType* sw_timer_functions[NUM_SW_TIMERS+1];
-volatile uint8_t sw_timer_once_only[NUM_SW_TIMERS+1];
-
-
-/* Set up AVR timer/counter 0 to give an interrupt 
-** 500 times per second (once every 2 milliseconds). We will divide 
-** the system clock by 64 so that timer/counter 0 increments every 
-** 16 micro-seconds (64/4000000 seconds). A count of 125 gives 
-** 2 milliseconds.
-** Timer/counter 0 can only give an interrupt on overflow (255 -> 0) 
-** so we set the initial counter value (TCNT0) to 256-125 = 131. 
-** (Timer/counter 0 does not have any output comparison 
-** functionality and it is only 8bits wide.) The first thing the 
-** interrupt handler will do is reset the timer value to 131.
+uint8_t sw_timer_heap[NUM_SW_TIMERS];
+uint8_t sw_timer_heap_size;
+
+/* Functions available within this file */
+static uint8_t deadline_before(uint8_t timerA, uint8_t timerB);
+static void heap_sift_up(uint8_t index);
+static void heap_sift_down(uint8_t index);
+static void heap_insert(uint8_t timer);
+static void heap_remove(uint8_t index);
+static void start_timer(uint8_t timer, uint16_t duration,
+		TimerFunctionType* timerFunction);
+
+/* Start the HAL's tick, which calls timer_tick() every 2 
+** milliseconds (on the AVR, from the timer/counter 0 overflow
+** interrupt).
 **
 ** It is assumed this function is called before global interrupts
 ** are enabled. Global interrupts must be enabled for the timer
@@ -46,28 +64,15 @@ volatile uint8_t sw_timer_once_only[NUM_SW_TIMERS+1];
 */
 
 void init_timer(void) {
-	uint8_t timerNum;
+	uint8_t timer;
 
-	/* Make the timer count every 64 system clock cycles */
-	TCCR0 = (0<<CS02)|(1<<CS01)|(1<<CS00);
-	/* Set the initial value of the timer/counter */
-	TCNT0 = 131;
-
-	/* Enable timer/counter 0 overflow interrupt. Set bit TOIE0
-	 * of the TIMSK register.
-	 */
-	TIMSK |= (1<<TOIE0);
-	
-	/* Clear the timer/counter 0 overflow flag by writing a 1
-	 * to the TOV0 bit of the TIFR register.
-	 */
-	TIFR = (1<<TOV0); 
-	
 	/* We start with no software timers */
-	for(timerNum = 0; timerNum <= NUM_SW_TIMERS; timerNum++) {
-		sw_timer_target[timerNum] = 0;
+	for(timer = 0; timer < NUM_SW_TIMERS; timer++) {
+		sw_timer_target[timer] = 0;
 	}
+	sw_timer_heap_size = 0;
 
+	hal_tick_init();
 }
 
 /* Function to register a function to be executed after a given 
@@ -80,30 +85,26 @@ uint8_t execute_function_once_after_delay(uint16_t delay,
 {
 	uint8_t timerNum;
 
+	/* Round up to a multiple of 2 (65535 wraps to 0 and is rejected) */
+	delay += delay & 1;
 	if(delay == 0) {
 		return 0;
 	}
 
 	/* Record whether interrupts are on, then turn interrupts off */
-	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
-	cli();
+	uint8_t interrupts_on = hal_interrupts_off();
 
 	/* Iterate over the timers until we find one not in use */
 	for(timerNum = NUM_SW_TIMERS; timerNum > 0; timerNum--) {
-		if(sw_timer_target[timerNum] == 0) {
+		if(sw_timer_target[timerNum - 1] == 0) {
 			/* Timer is not in use */
-			sw_timer_values[timerNum] = 0;	/* Start count for this timer at 0 */
-			sw_timer_target[timerNum] = delay;
-			sw_timer_functions[timerNum] = timerFunction;
-			sw_timer_once_only[timerNum] = 1;
+			start_timer(timerNum - 1, delay, timerFunction);
 			break;
 		}
 	}
 
 	/* If interrupts were on when we started, turn them back on */
-	if(interrupts_on) {
-		sei();
-	}
+	hal_interrupts_restore(interrupts_on);
 	return timerNum;
 }
 
@@ -117,109 +118,198 @@ uint8_t execute_function_periodically(uint16_t period,
 	uint8_t timerNum;
 
 	/* Record whether interrupts are on, then turn interrupts off */
-	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
-	cli();
+	uint8_t interrupts_on = hal_interrupts_off();
 
 	/* Use the function above to add a once-only function, then update
 	** the field that records whether the timer is once only or periodic.
 	*/
 	timerNum = execute_function_once_after_delay(period, timerFunction);
 	if(timerNum) {
-		sw_timer_once_only[timerNum] = 0;
+		sw_timer_once_only &= ~(1 << (timerNum - 1));
 	}
 
 	/* If interrupts were on when we started, turn them back on */
-	if(interrupts_on) {
-		sei();
-	}
+	hal_interrupts_restore(interrupts_on);
 	return timerNum;
 
 }
 
 
 /* Function to stop a software timer. Turn off interrupts
-** while we do this and re-enable afterwards.
+** while we do this and re-enable afterwards. (Timer number 0, which
+** no request is given, is ignored.)
 */
 void cancel_software_timer(uint8_t timerNum)
 {
-	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
-	cli();
-	sw_timer_target[timerNum] = 0;
-	if(interrupts_on) {
-		sei();
+	uint8_t index;
+	uint8_t timer = timerNum - 1;
+	uint8_t interrupts_on = hal_interrupts_off();
+	if(timer < NUM_SW_TIMERS && sw_timer_target[timer]) {
+		/* Find the timer in the heap and take it out */
+		for(index = 0; index < sw_timer_heap_size; index++) {
+			if(sw_timer_heap[index] == timer) {
+				heap_remove(index);
+				break;
+			}
+		}
+		sw_timer_target[timer] = 0;
 	}
+	hal_interrupts_restore(interrupts_on);
 }
 
-/* Function to get the value of a software timer
+/* Function to get the value of a software timer, i.e. the time
+** since it was started (or last expired, for a periodic timer)
 */
 uint16_t get_sw_timer_value(uint8_t timerNum)
 {
-	return sw_timer_values[timerNum];
+	uint16_t value;
+	uint8_t interrupts_on = hal_interrupts_off();
+	value = sw_timer_target[timerNum - 1] - 
+			(uint16_t)(sw_timer_deadline[timerNum - 1] - time);
+	hal_interrupts_restore(interrupts_on);
+	return value;
 }
 
 /* 
-** Wait for a timer to wrap around back to 0. Interrupts must be on 
-** when this is called.
+** Wait until time reaches the end of the delay. time is two bytes, so
+** it is read with interrupts off.
 */
 void wait_for(uint16_t delay)
 {
-	/* Disable interrupts */
-	cli();
-
-	sw_timer_values[0] = 0;	/* Start count for this timer at 0 */
-	sw_timer_target[0] = delay;
-	sw_timer_functions[0] = 0;
-	sw_timer_once_only[0] = 1;
-
-	/* Reenable interrupts and wait until our target is reset to 0
-	** (This will happen in the ISR) */
-	sei();
+	uint16_t end;
+	uint16_t now;
 
-	while(sw_timer_target[0]) {
-		; /* Do nothing */
+	delay += delay & 1;
+	if(delay == 0) {
+		return;
 	}
+
+	hal_interrupts_off();
+	end = time + delay;
+	hal_interrupts_on();
+	do {
+		hal_interrupts_off();
+		now = time;
+		hal_interrupts_on();
+	} while(now != end);
 }
 
 /*
-** Interrupt handler for timer 0 overflow. The CPU will clear the 
-** overflow flag (TOV0) on calling this handler.
+** Interrupt handler for the 2ms tick - called by the HAL.
 */
-ISR(TIMER0_OVF_vect) {
-	uint8_t timerNum;
-	/*
-	** Reset the timer so the next interrupt happens 
-	** at an appropriate time (i.e. in 2ms)
-	*/
-	TCNT0 = 131;
+void timer_tick(void) {
+	uint8_t timer;
 	
 	/*
 	** Update our global time variable
 	*/
 	time+=2;
 	
-	/* Check our software timers */
-	for(timerNum = 0; timerNum <= NUM_SW_TIMERS; timerNum++) {
-		/* For each timer, check whether it is running or not */
-		if(sw_timer_target[timerNum]) {
-			/* Timer is running - increment it */
-			sw_timer_values[timerNum] += 2;
-			/* If we have passed our target - call the given 
-			** function.
-			*/
-			if(sw_timer_values[timerNum] >= sw_timer_target[timerNum]) {
-				/* Call the registered function (if any) */
-				if(sw_timer_functions[timerNum]) {
-					sw_timer_functions[timerNum]();
-				}
-				/* Check if this was a once off */
-				if(sw_timer_once_only[timerNum]) {
-					/* Was once off - cancel the timer */
-					sw_timer_target[timerNum] = 0;
-				} else {
-					/* Wasn't once off - reset the timer */
-					sw_timer_values[timerNum] = 0;
-				}
-			}
+	/* Run the software timers that have reached their deadline. 
+	** These are all at the top of the heap.
+	*/
+	while(sw_timer_heap_size && 
+			sw_timer_deadline[sw_timer_heap[0]] == time) {
+		timer = sw_timer_heap[0];
+		/* Check if this was a once off */
+		if(sw_timer_once_only & (1 << timer)) {
+			/* Was once off - cancel the timer */
+			sw_timer_target[timer] = 0;
+			heap_remove(0);
+		} else {
+			/* Wasn't once off - move the deadline on one period */
+			sw_timer_deadline[timer] += sw_timer_target[timer];
+			heap_sift_down(0);
 		}
+		/* Call the registered function (if any). This is done
+		** last so that the function can safely start or cancel
+		** timers (including this one).
+		*/
+		if(sw_timer_functions[timer]) {
+			sw_timer_functions[timer]();
+		}
+	}
+}
+
+/* Set up the software timer at the given index and add it to the
+** heap. Interrupts must be off.
+*/
+static void start_timer(uint8_t timer, uint16_t duration,
+		TimerFunctionType* timerFunction)
+{
+	sw_timer_deadline[timer] = time + duration;
+	sw_timer_target[timer] = duration;
+	sw_timer_functions[timer] = timerFunction;
+	sw_timer_once_only |= 1 << timer;
+	heap_insert(timer);
+}
+
+/* Heap operations - interrupts must be off when these are called */
+
+/* Returns true if timerA's deadline is before timerB's */
+static uint8_t deadline_before(uint8_t timerA, uint8_t timerB)
+{
+	return (uint16_t)(sw_timer_deadline[timerA] - time) <
+			(uint16_t)(sw_timer_deadline[timerB] - time);
+}
+
+static void heap_sift_up(uint8_t index)
+{
+	uint8_t parent;
+	uint8_t timer;
+
+	timer = sw_timer_heap[index];
+	while(index > 0) {
+		parent = (index - 1) / 2;
+		if(!deadline_before(timer, sw_timer_heap[parent])) {
+			break;
+		}
+		sw_timer_heap[index] = sw_timer_heap[parent];
+		index = parent;
+	}
+	sw_timer_heap[index] = timer;
+}
+
+static void heap_sift_down(uint8_t index)
+{
+	uint8_t child;
+	uint8_t timer;
+
+	timer = sw_timer_heap[index];
+	for(;;) {
+		child = 2 * index + 1;
+		if(child >= sw_timer_heap_size) {
+			break;
+		}
+		/* Pick the child with the earlier deadline */
+		if(child + 1 < sw_timer_heap_size && 
+				deadline_before(sw_timer_heap[child + 1], sw_timer_heap[child])) {
+			child++;
+		}
+		if(!deadline_before(sw_timer_heap[child], timer)) {
+			break;
+		}
+		sw_timer_heap[index] = sw_timer_heap[child];
+		index = child;
+	}
+	sw_timer_heap[index] = timer;
+}
+
+static void heap_insert(uint8_t timer)
+{
+	sw_timer_heap[sw_timer_heap_size] = timer;
+	heap_sift_up(sw_timer_heap_size++);
+}
+
+/* Remove the entry at the given index by moving the last entry
+** into its place and restoring the heap order around it
+*/
+static void heap_remove(uint8_t index)
+{
+	sw_timer_heap_size--;
+	if(index < sw_timer_heap_size) {
+		sw_timer_heap[index] = sw_timer_heap[sw_timer_heap_size];
+		heap_sift_down(index);
+		heap_sift_up(index);
 	}
 }
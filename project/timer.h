@@ -30,9 +30,17 @@ extern volatile uint16_t time;
 /*
 ** There are a fixed number of software timers based on this clock. 
 ** The timer numbers range from 1 to NUM_SW_TIMERS. (This number
-** can be adjusted if necessary but must fit in a uint8_t type.)
+** can be adjusted if necessary but must be no more than 8.) Active
+** timers are kept ordered by deadline, so the cost of each clock
+** tick depends on the number of timers that expire, not on this
+** number. Each timer takes 7 bytes of RAM, so there are only as many
+** as the game uses - the game tick, the food blink (without
+** brightness levels) and the sound - and one spare. (The display scan
+** is called by the HAL on every tick.)
 */
-#define NUM_SW_TIMERS 8
+#ifndef NUM_SW_TIMERS
+#define NUM_SW_TIMERS 4
+#endif
 
 /* The following type definition is the type of functions that can
 ** be registered to be executed periodically, i.e., such functions
@@ -8,109 +8,170 @@
 
 #include "wall.h"
 #include "board.h"
-#include "timer.h"
 
 //for debugging
 #include "led_display.h"
 #include "terminalio.h"
 #include <stdio.h>
-#include <avr/pgmspace.h>
+#include "hal.h"
 //
 
 
-/* Store the wall positions created by a tail-cut in an array */
+/* Store the wall positions created by a tail-cut in a circular
+** buffer, oldest wall first. wallTail is the index of the oldest
+** segment and wallSegments is the number of segments stored. New
+** segments go in at (wallTail + wallSegments), wrapping around. The
+** last segment of each wall is marked with WALL_END (positions only
+** use 7 bits - x is less than 8), so no lengths need to be stored.
+*/
+#define WALL_END 0x80
+
 PosnType wallPositions[MAX_WALL_SIZE];
+uint8_t wallTail;
+uint8_t wallSegments;
 
-/* Store wall indexes 
-** Store as position type, but
-** x value is the start index
-** y value is the end index
+/* Segments added since the last wall was flagged */
+uint8_t newWallLength;
+
+/* Wall clock - counts calls to expire_walls(). Each wall records
+** the wall clock value at which it expires, in a circular buffer
+** oldest wall first. oldestWall is the index of the oldest wall and
+** numWalls the number of walls. All walls live for the same time,
+** so the oldest wall always expires first.
 */
-PosnType wallIndexes[MAX_NUM_WALLS];
+uint8_t wallClock;
+uint8_t wallExpiry[MAX_NUM_WALLS];
+uint8_t oldestWall;
+uint8_t numWalls;
 
-// Keep track of wall segments
-uint8_t wallInsertionIndex;
-// Keep track of entire walls
-uint8_t newWallIndex;
+/* Functions available within this file */
+static uint8_t segment_index(uint8_t offset);
 
 void init_walls(void){
-	wallInsertionIndex = 0;
-	while(wallInsertionIndex < MAX_WALL_SIZE){
-		wallPositions[wallInsertionIndex++] = 0xFF;
-	}
-	wallInsertionIndex = 0;
+	wallTail = 0;
+	wallSegments = 0;
+	oldestWall = 0;
+	numWalls = 0;
+	newWallLength = 0;
+	wallClock = 0;
 }
 
 /* is_wall_at
-**		Check all wall positions and see if any part of the 
-**		wall is at the given position
+**		Check whether any part of a wall is at the given
+**		position - a single test of the wall occupancy layer
 */
 int8_t is_wall_at(PosnType position) {
-	int8_t index = 0;
-
-	while(index < MAX_WALL_SIZE) {
-		if(position == wallPositions[index]) {
-			return 1;
-		}
-		index++;
-	}
-
-	/* There is no wall here */
-	return 0;
+	return is_occupied(WALL_LAYER, position);
 }
 
 /* Adds a wall element at the given position */
 int8_t add_wall_at(PosnType position){
 	//Don't add a wall if there's no more room
-	if(wallInsertionIndex < MAX_WALL_SIZE){
-		wallPositions[wallInsertionIndex++] = position;
+	if(wallSegments < MAX_WALL_SIZE){
+		store_wall_segment(position);
+		set_occupied(WALL_LAYER, position);
 		return 1;
 	}
 	//we couldn't place a wall
 	return 0;
 }
 
+uint8_t wall_space(void){
+	return MAX_WALL_SIZE - wallSegments;
+}
+
+/* Adds a segment to the store (there must be room) */
+void store_wall_segment(PosnType position){
+	wallPositions[segment_index(wallSegments)] = position;
+	wallSegments++;
+	newWallLength++;
+}
+
 void show_walls(void) {
-	int8_t i;
-	for(i=0; i < MAX_WALL_SIZE; i++) {
-	//food and walls are the same in terms of lighting
-		add_food_item_to_board(wallPositions[i]);
+	uint8_t i;
+	uint8_t index;
+	//only visit the segments in use
+	index = wallTail;
+	for(i=0; i < wallSegments; i++) {
+		set_occupied(WALL_LAYER, wallPositions[index] & ~WALL_END);
+		if(++index == MAX_WALL_SIZE) {
+			index = 0;
+		}
 	}
 }
 
-/* inserts a wall into wallIndexes and flags it for
-** removal after a certain amount of time
+/* makes the segments added since the last call into a wall
+** and flags it for removal after WALL_LIFETIME wall clock ticks
 */
-void flag_wall(PosnType wall){
-	if(newWallIndex < MAX_NUM_WALLS) {
-		wallIndexes[newWallIndex++] = wall;
-		execute_function_once_after_delay(10000, remove_wall);
+void flag_wall(void){
+	uint8_t index;
+	if(newWallLength == 0) {
+		/* Nothing was cut */
+		return;
+	}
+	wallPositions[segment_index(wallSegments - 1)] |= WALL_END;
+	if(numWalls < MAX_NUM_WALLS) {
+		index = oldestWall + numWalls;
+		if(index >= MAX_NUM_WALLS) {
+			index -= MAX_NUM_WALLS;
+		}
+		numWalls++;
+	} else {
+		/* No room - join it onto the newest wall */
+		wallPositions[segment_index(wallSegments - newWallLength - 1)] &= 
+				~WALL_END;
+		index = oldestWall + numWalls - 1;
+		if(index >= MAX_NUM_WALLS) {
+			index -= MAX_NUM_WALLS;
+		}
 	}
+	wallExpiry[index] = wallClock + WALL_LIFETIME;
+	newWallLength = 0;
 }
 
-/* removes a wall from wallIndexes and removes it
-** from the board. Note, they will be removed in the
-** order they were added
+/* removes the oldest wall from the board. Note, they
+** will be removed in the order they were added. Only
+** the segments of that wall are visited - nothing is
+** moved.
 */
 void remove_wall(){
-	int8_t i, j, start, stop;
-	start = x_position(wallIndexes[0]);
-	stop = y_position(wallIndexes[0]);
-	//shift wallPositions to create more space at the end
-	//remove from board as we go along
-	for(i = start; i < stop; i++) {
-		remove_food_item_from_board(wallPositions[start]);
-		
-		//empty_display();
-		for(j = start; j < MAX_WALL_SIZE; j++){
-			wallPositions[j] = wallPositions[j + 1];
+	PosnType position;
+	if(numWalls == 0) {
+		/* No walls left (they were reset) */
+		return;
+	}
+	do {
+		position = wallPositions[wallTail];
+		clear_occupied(WALL_LAYER, position & ~WALL_END);
+		if(++wallTail == MAX_WALL_SIZE) {
+			wallTail = 0;
 		}
+		wallSegments--;
+	} while(!(position & WALL_END));
+
+	if(++oldestWall == MAX_NUM_WALLS) {
+		oldestWall = 0;
 	}
-	wallInsertionIndex -= stop - start;
+	numWalls--;
+}
+
+/* advances the wall clock and removes the walls that have
+** expired. Only the oldest wall needs to be checked each time.
+*/
+void expire_walls(void){
+	wallClock++;
+	while(numWalls && (int8_t)(wallClock - wallExpiry[oldestWall]) >= 0) {
+		remove_wall();
+	}
+}
 
-	//shift wallIndexes
-	for(i = 0; i < MAX_NUM_WALLS; i++){
-		wallIndexes[i] = wallIndexes[i + 1];
+/* Returns the index in wallPositions of the segment offset places
+** after the oldest one
+*/
+static uint8_t segment_index(uint8_t offset){
+	uint8_t index = wallTail + offset;
+	if(index >= MAX_WALL_SIZE) {
+		index -= MAX_WALL_SIZE;
 	}
-	newWallIndex--;
+	return index;
 }
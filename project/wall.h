@@ -6,42 +6,75 @@
 ** Handle stationary obstacles
 */
 
+/* Guard band to ensure this definition is only included once */
+#ifndef WALL_H
+#define WALL_H
+
 #include <inttypes.h>
 #include "position.h"
 
 #define MAX_WALL_SIZE 36
 
-/* Store start and stop indexes of walls
-** Each wall is at least one segment long
-** Choose worst case of all walls one segment
+/* The number of walls whose expiry times are kept. If a wall is
+** flagged when there are already this many, it is joined onto the
+** newest wall, which then lasts as long as the new one. (A tail-cut
+** makes at most one wall each move, so this only happens when walls
+** are cut faster than one every WALL_LIFETIME / MAX_NUM_WALLS ticks.)
+*/
+#define MAX_NUM_WALLS 8
+
+/* Walls are expired by calling expire_walls() every WALL_TICK_PERIOD
+** milliseconds (by the game clock - see game.h) and each wall lasts
+** for WALL_LIFETIME of those ticks (10 seconds). WALL_LIFETIME must
+** be less than 128.
 */
-#define MAX_NUM_WALLS 36 
+#define WALL_TICK_PERIOD 100
+#define WALL_LIFETIME 100
 
 void init_walls(void);
 
 /* is_wall_at
-**		Check all wall positions and see if any part of the 
-**		wall is at the given position
+**		Check whether any part of a wall is at the
+**		given position
 */
 int8_t is_wall_at(PosnType);
 
 /* Adds a wall element at the given position */
 int8_t add_wall_at(PosnType);
 
+/* wall_space() returns the number of wall elements that can still
+** be added. store_wall_segment() adds one (there must be room)
+** without marking it on the wall occupancy layer - for cells which
+** the caller moves onto that layer itself (see move_occupied()).
+*/
+uint8_t wall_space(void);
+void store_wall_segment(PosnType);
+
 /* show_walls(void)
 **
-** Display the walls on the board
+** Mark the walls on the wall occupancy layer (which
+** is shown on the display)
 */
 void show_walls(void);
 
 /* flag_wall(void)
 **
-** Inserts a new wall and flags it for deletion
+** Makes the elements added by add_wall_at() since the
+** last call into a new wall and flags it for deletion
 */
-void flag_wall(PosnType);
+void flag_wall(void);
 
 /* remove_wall(void)
 **
-** Removes the first wall in the list
+** Removes the oldest wall
 */
 void remove_wall(void);
+
+/* expire_walls(void)
+**
+** Advances the wall clock by one tick and removes any
+** walls that have expired
+*/
+void expire_walls(void);
+
+#endif